@@ -1,11 +1,17 @@
 #ifndef COM_PORTS_H
 #define COM_PORTS_H
 
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <string>
 #include <vector>
-#include <windows.h>
+
+#include "device_stats.h"
+#include "frame_capture.h"
+#include "frame_parser.h"
+#include "reconnect_backoff.h"
+#include "wake_handle.h"
 
 namespace com_ports {
 constexpr int32_t kMaxPort{255};
@@ -13,32 +19,115 @@ constexpr int32_t kMaxPort{255};
 struct ComPortData {
 	int32_t index;
 	std::string friendly_name;
+	std::string path;
+	// Survives replugs and renumbering, the /dev/serial/by-id name on
+	// Linux and the device instance id (USB vendor, product and serial)
+	// on Windows. Empty when the port has none.
+	std::string id;
 };
 
 std::vector<ComPortData> FetchCOMPorts();
-std::string GetFriendlyName(int32_t device);
+std::string PortPath(int32_t com_index);
+// Current path of a port given as an id or a path, paths are returned
+// unchanged. Empty while the adapter with that id is not connected.
+std::string ResolvePort(std::string const &port);
+
+constexpr uint64_t kNoDeadline{UINT64_MAX};
+constexpr int32_t kDefaultBaudRate{115200};
+
+// kNegotiate sends kPackedHandshake after every connect and accepts packed
+// frames once the firmware starts sending them, kLegacy never writes to the
+// port
+enum class WireProtocol { kLegacy = 0, kNegotiate };
 
-class COMDevice {
+// Serial input source. Backends only move bytes into the parser, the frame
+// dispatch to the data and graphics callbacks is shared. The data callback
+// returns whether the frame changed anything, the graphics callback is only
+// called for frames that did.
+//
+// Devices are driven by the IOReactor through PollHandle, ReadAvailable and
+// Service. Tick runs the same hooks standalone on the calling thread.
+class Device {
 public:
-	COMDevice(int32_t com_index, int32_t baud_rate, size_t read_buffer_size,
-		  std::function<void(char *)> const &set_data_callback,
-		  std::function<void()> const &graphics_update_callback);
-	~COMDevice();
+	using DataCallback = std::function<bool(Frame const &)>;
+	using UpdateCallback = std::function<void()>;
+
+	// port is an id or a path as accepted by ResolvePort, backends
+	// resolve it again before every reconnect attempt
+	static Device *Create(std::string const &port, int32_t baud_rate,
+			      WireProtocol protocol, size_t frame_size,
+			      char delimiter,
+			      DataCallback const &set_data_callback,
+			      UpdateCallback const &graphics_update_callback);
+
+	Device(size_t frame_size, char delimiter, WireProtocol protocol,
+	       DataCallback const &set_data_callback,
+	       UpdateCallback const &graphics_update_callback);
+	virtual ~Device();
+
+	virtual bool Valid() const = 0;
+
+	// Waits at most kMaxTickWait for input or the next service deadline
+	virtual void Tick();
+	// Makes a Tick in progress on another thread return right away
+	void Interrupt();
+
+	// Readable descriptor to wait on, -1 while there is none
+	virtual int PollHandle() const;
+	// Drains the handle without blocking, hangup is set when the handle
+	// reported an error or hangup. Closing the handle is allowed here.
+	virtual void ReadAvailable(bool hangup);
+	// Timed work such as reconnecting or paced replay, returns the next
+	// time the device wants to be serviced or kNoDeadline
+	virtual uint64_t Service(uint64_t now_ns);
+
+	// Can be sampled from any thread at any time
+	DeviceStats Stats() const;
+	// Called from any thread when the OS reports a new serial device, a
+	// disconnected device then retries right away at its next Service
+	void OnDeviceArrival();
+	// Whether the device lost its port and waits to reconnect, kept up to
+	// date by Tick and safe to sample from any thread
+	bool AwaitingReconnect() const;
+
+	// Appends every complete frame with its arrival time to a capture
+	// file, call before the device starts ticking
+	bool StartCapture(std::string const &path);
+
+protected:
+	size_t DispatchFrames();
+	// Called by backends after every successful connect
+	void BeginSession();
+	// Blocking write used for the handshake, false when unsupported
+	virtual bool Write(char const *data, size_t size);
+	// Applies a pending device arrival to reconnect_
+	void ConsumeDeviceArrival(uint64_t now_ns);
 
-	bool Valid();
-	void Tick();
+	FrameParser parser_;
+	WireProtocol const protocol_;
+	FrameCapture *capture_;
+	// Included in every blocking wait, signaled by Interrupt
+	WakeHandle wake_;
+	ReconnectBackoff reconnect_;
+	DataCallback set_data_callback_;
+	UpdateCallback graphics_update_callback_;
 
 private:
-	bool TryReconnecting();
+	char const *CaptureFrame(char const *data, FrameFormat format);
 
-	HANDLE handle_;
-	int32_t com_index_;
-	int32_t baud_rate_;
+	void PublishParserCounters();
 
-	size_t const kBufferSize;
-	char *read_buffer_;
-	std::function<void(char *)> set_data_callback_;
-	std::function<void()> graphics_update_callback_;
+	uint64_t tick_deadline_ns_;
+	DeviceCounters counters_;
+	std::atomic<bool> device_arrived_;
+	std::atomic<bool> awaiting_reconnect_;
+	// Reading thread only
+	uint64_t sessions_;
+	uint8_t expected_sequence_;
+	bool has_sequence_;
+	// Legacy expansion of packed frames, captures always hold legacy frames
+	std::vector<char> capture_frame_;
+	FrameFormat reported_format_;
 };
 
 } // namespace com_ports
@@ -0,0 +1,30 @@
+#ifndef CONTROLLER_STATE_H
+#define CONTROLLER_STATE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace slask_spy {
+// Largest frame of any supported controller, delimiter included
+constexpr size_t kMaxDataBytes{65};
+// Largest payload, one bit per frame byte
+constexpr size_t kMaxInputBits{64};
+constexpr size_t kMaxAxes{kMaxInputBits / 8};
+
+// Frame packed one bit per input, handed from the reading thread to the
+// render thread. Bit i of buttons is frame byte i, axes holds the same bits
+// regrouped into bytes most significant bit first, the order axis values are
+// sent in.
+struct ControllerState {
+	uint64_t buttons;
+	uint8_t axes[kMaxAxes];
+	// Monotonic times the frame was read and packed
+	uint64_t arrival_ns;
+	uint64_t decoded_ns;
+
+	bool Button(int32_t index) const { return (buttons >> index) & 1U; }
+	uint8_t Axis(int32_t index) const { return axes[index >> 3]; }
+};
+} // namespace slask_spy
+
+#endif // CONTROLLER_STATE_H
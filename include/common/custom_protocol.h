@@ -0,0 +1,94 @@
+#ifndef CUSTOM_PROTOCOL_H
+#define CUSTOM_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#include "controller_state.h"
+
+namespace slask_spy {
+// Frame layout of firmware without a built-in viewer, read from
+// protocol.xml next to the skin.xml of a skin with type "custom":
+//
+//   <protocol frame_bytes="25" delimiter="10">
+//     <button name="a" bit="0"/>
+//     <axis name="stick_x" bit="8" bits="8" signed="true"/>
+//   </protocol>
+//
+// frame_bytes includes the delimiter, the payload holds at most
+// kMaxInputBits bits. Axes are one to eight bits sent most significant bit
+// first, inputs may not overlap.
+//
+// Load compiles the layout into a gather plan moving every input to where
+// the built-in viewers keep it: buttons on a bit each and axes on a byte
+// each, scaled to eight bits and centered at 128. Decoding is then the
+// built-in bit packing followed by Gather.
+class CustomProtocol {
+public:
+	// Sticks are centered at 128 whatever their signedness
+	static constexpr int32_t kAxisCenter{128};
+
+	// Logs the problem and returns nullptr when the file is invalid. The
+	// protocol and its index are allocated from resource, the caller runs
+	// the destructor and gives the memory back.
+	static CustomProtocol *Load(std::string const &path,
+				    std::pmr::memory_resource *resource);
+
+	size_t DataBytes() const { return data_bytes_; }
+	char Delimiter() const { return delimiter_; }
+	bool HasAxes() const { return has_axes_; }
+	// Index to assign skin elements to, -1 when the name is unknown
+	int32_t Find(std::string_view name) const;
+
+	// Frame bits in, bits in ControllerState order out
+	uint64_t Gather(uint64_t bits) const
+	{
+#if defined(__BMI2__)
+		return _pdep_u64(_pext_u64(bits, source_mask_), target_mask_) ^
+		       flip_mask_;
+#else
+		uint64_t gathered{0};
+		for (size_t i{0}; i < run_count_; ++i) {
+			Run const &run{runs_[i]};
+			gathered |= ((bits >> run.source) & run.mask)
+				    << run.target;
+		}
+		return gathered ^ flip_mask_;
+#endif
+	}
+
+private:
+	// Bits that move together, neighbouring inputs share a run
+	struct Run {
+		uint64_t mask;
+		uint32_t source;
+		uint32_t target;
+	};
+
+	explicit CustomProtocol(std::pmr::memory_resource *resource);
+
+	size_t data_bytes_;
+	char delimiter_;
+	bool has_axes_;
+	std::pmr::map<std::pmr::string, int32_t, std::less<>> indices_;
+	// Source and target bits are both in frame order, so a pext into a
+	// pdep moves everything at once
+	uint64_t source_mask_;
+	uint64_t target_mask_;
+	// Most significant bit of every signed axis, turns two's complement
+	// into offset binary
+	uint64_t flip_mask_;
+	Run runs_[kMaxInputBits];
+	size_t run_count_;
+};
+} // namespace slask_spy
+
+#endif // CUSTOM_PROTOCOL_H
@@ -0,0 +1,52 @@
+#ifndef DEVICE_STATS_H
+#define DEVICE_STATS_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace com_ports {
+// Plain copy of the health counters of a device, totals since it was created
+struct DeviceStats {
+	// Accepted and handed to the data callback
+	uint64_t frames_received;
+	// Missing according to the packed sequence numbers
+	uint64_t frames_dropped;
+	// Failed the CRC or held bytes that are not bits
+	uint64_t frames_corrupt;
+	// Times framing was lost and had to be found again
+	uint64_t resyncs;
+	uint64_t reconnects;
+	uint64_t bytes_read;
+};
+
+// Only written by the reading thread, so an increment is a relaxed load and
+// store instead of a locked read-modify-write. Load can be called from any
+// thread and never blocks the reader.
+struct DeviceCounters {
+	std::atomic<uint64_t> frames_received{0};
+	std::atomic<uint64_t> frames_dropped{0};
+	std::atomic<uint64_t> frames_corrupt{0};
+	std::atomic<uint64_t> resyncs{0};
+	std::atomic<uint64_t> reconnects{0};
+	std::atomic<uint64_t> bytes_read{0};
+
+	static void Add(std::atomic<uint64_t> &counter, uint64_t value)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + value,
+			      std::memory_order_relaxed);
+	}
+
+	DeviceStats Load() const
+	{
+		return DeviceStats{
+			frames_received.load(std::memory_order_relaxed),
+			frames_dropped.load(std::memory_order_relaxed),
+			frames_corrupt.load(std::memory_order_relaxed),
+			resyncs.load(std::memory_order_relaxed),
+			reconnects.load(std::memory_order_relaxed),
+			bytes_read.load(std::memory_order_relaxed)};
+	}
+};
+} // namespace com_ports
+
+#endif // DEVICE_STATS_H
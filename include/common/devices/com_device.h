@@ -0,0 +1,39 @@
+#ifndef COM_DEVICE_H
+#define COM_DEVICE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <windows.h>
+
+#include "com_ports.h"
+
+namespace com_ports {
+class COMDevice : public Device {
+public:
+	COMDevice(std::string const &port, int32_t baud_rate,
+		  WireProtocol protocol, size_t frame_size,
+		  char delimiter, DataCallback const &set_data_callback,
+		  UpdateCallback const &graphics_update_callback);
+	~COMDevice() override;
+
+	bool Valid() const override;
+	void Tick() override;
+
+protected:
+	bool Write(char const *data, size_t size) override;
+
+private:
+	bool TryReconnecting();
+	void TickDisconnected();
+	void OnReadError(DWORD error_code);
+
+	HANDLE handle_;
+	// Completion event for the overlapped read
+	HANDLE read_event_;
+	std::string const port_;
+	int32_t baud_rate_;
+};
+} // namespace com_ports
+
+#endif // COM_DEVICE_H
@@ -0,0 +1,42 @@
+#ifndef REPLAY_DEVICE_H
+#define REPLAY_DEVICE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "com_ports.h"
+
+namespace com_ports {
+// Plays a file written by FrameCapture back through the regular parse and
+// dispatch path, looping at the end. speed scales the recorded pacing, 0
+// replays as fast as possible.
+class ReplayDevice : public Device {
+public:
+	ReplayDevice(std::string const &path, double speed, size_t frame_size,
+		     char delimiter, DataCallback const &set_data_callback,
+		     UpdateCallback const &graphics_update_callback);
+	~ReplayDevice() override;
+
+	bool Valid() const override;
+	uint64_t Service(uint64_t now_ns) override;
+
+private:
+	bool Rewind();
+	uint64_t ServicePaced(uint64_t now_ns);
+	uint64_t ServiceUnpaced(uint64_t now_ns);
+
+	FILE *file_;
+	std::string const path_;
+	double const speed_;
+	std::vector<char> pending_frame_;
+	uint64_t pending_timestamp_ns_;
+	bool has_pending_;
+	uint64_t first_timestamp_ns_;
+	uint64_t start_ns_;
+};
+} // namespace com_ports
+
+#endif // REPLAY_DEVICE_H
@@ -0,0 +1,39 @@
+#ifndef TERMIOS_DEVICE_H
+#define TERMIOS_DEVICE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "com_ports.h"
+
+namespace com_ports {
+// POSIX tty backend. Any character device works, including the slave side of
+// a pseudo-terminal, which makes the read path testable without hardware.
+class TermiosDevice : public Device {
+public:
+	TermiosDevice(std::string const &port, int32_t baud_rate,
+		      WireProtocol protocol, size_t frame_size,
+		      char delimiter, DataCallback const &set_data_callback,
+		      UpdateCallback const &graphics_update_callback);
+	~TermiosDevice() override;
+
+	bool Valid() const override;
+	int PollHandle() const override;
+	void ReadAvailable(bool hangup) override;
+	uint64_t Service(uint64_t now_ns) override;
+
+protected:
+	bool Write(char const *data, size_t size) override;
+
+private:
+	bool TryReconnecting();
+	void Close();
+
+	int fd_;
+	std::string const port_;
+	int32_t baud_rate_;
+};
+} // namespace com_ports
+
+#endif // TERMIOS_DEVICE_H
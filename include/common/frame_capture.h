@@ -0,0 +1,42 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace com_ports {
+// Capture files start with kCaptureMagic, a version byte and the frame size
+// as a little endian uint32. Every record after that is a little endian
+// uint64 monotonic timestamp in nanoseconds followed by the raw frame,
+// delimiter included.
+constexpr char kCaptureMagic[7]{'S', 'S', 'P', 'Y', 'C', 'A', 'P'};
+constexpr uint8_t kCaptureVersion{1};
+constexpr size_t kCaptureHeaderSize{sizeof(kCaptureMagic) + 1 + 4};
+
+class FrameCapture {
+public:
+	static FrameCapture *Open(std::string const &path, size_t frame_size);
+	~FrameCapture();
+
+	FrameCapture(FrameCapture const &) = delete;
+	FrameCapture &operator=(FrameCapture const &) = delete;
+
+	void Append(char const *frame, uint64_t timestamp_ns);
+
+private:
+	FrameCapture(FILE *file, size_t frame_size);
+
+	FILE *file_;
+	size_t const kFrameSize;
+};
+
+// Reads back the header written by FrameCapture, returns false when the file
+// is not a capture
+bool ReadCaptureHeader(FILE *file, size_t *frame_size);
+// Reads the next record into frame, returns false at the end of the file
+bool ReadCaptureRecord(FILE *file, size_t frame_size, char *frame,
+		       uint64_t *timestamp_ns);
+} // namespace com_ports
+
+#endif // FRAME_CAPTURE_H
@@ -0,0 +1,87 @@
+#ifndef FRAME_DECODER_H
+#define FRAME_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "controller_state.h"
+
+namespace slask_spy {
+// Packs a frame sent as one byte per bit into a bit mask, any non-zero byte
+// is a set bit. bits must not exceed kMaxInputBits.
+uint64_t PackFrameBits(char const *data, size_t bits);
+
+// Decodes the payload of a frame, delimiter excluded, into state
+void DecodeFrame(char const *data, size_t bits, ControllerState *state);
+
+// Loads a packed payload holding the bits eight to a byte, lowest first,
+// into a bit mask
+uint64_t LoadPackedBits(uint8_t const *payload, size_t bits);
+
+// Same as DecodeFrame for a packed payload
+void DecodePackedFrame(uint8_t const *payload, size_t bits,
+		       ControllerState *state);
+
+// Reverses the bit order inside every byte, turning the first-byte-lowest
+// button mask into most significant bit first axis bytes
+inline uint64_t ReverseBitsInBytes(uint64_t value)
+{
+	value = ((value >> 1) & 0x5555555555555555ULL) |
+		((value & 0x5555555555555555ULL) << 1);
+	value = ((value >> 2) & 0x3333333333333333ULL) |
+		((value & 0x3333333333333333ULL) << 2);
+	value = ((value >> 4) & 0x0F0F0F0F0F0F0F0FULL) |
+		((value & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	return value;
+}
+
+inline void DecodeAxes(ControllerState *state)
+{
+	uint64_t const axes{ReverseBitsInBytes(state->buttons)};
+	for (size_t i{0}; i < kMaxAxes; ++i) {
+		state->axes[i] = static_cast<uint8_t>(axes >> (i * 8));
+	}
+}
+
+// Variants for a frame size known at compile time, used by ProtocolViewer.
+// Frames shorter than one vector are packed with a loop the compiler
+// unrolls and the axis bytes are only derived when kAxes is set.
+template<size_t kBits, bool kAxes>
+void DecodeFixedFrame(char const *data, ControllerState *state)
+{
+	static_assert(kBits <= kMaxInputBits);
+	if constexpr (kBits < 16) {
+		uint64_t buttons{0};
+		for (size_t i{0}; i < kBits; ++i) {
+			buttons |= static_cast<uint64_t>(data[i] != 0) << i;
+		}
+		state->buttons = buttons;
+	} else {
+		state->buttons = PackFrameBits(data, kBits);
+	}
+
+	if constexpr (kAxes) {
+		DecodeAxes(state);
+	}
+}
+
+template<size_t kBits, bool kAxes>
+void DecodeFixedPackedFrame(uint8_t const *payload, ControllerState *state)
+{
+	static_assert(kBits <= kMaxInputBits);
+	uint64_t buttons{0};
+	for (size_t i{0}; i < (kBits + 7) / 8; ++i) {
+		buttons |= static_cast<uint64_t>(payload[i]) << (i * 8);
+	}
+	if constexpr (kBits < kMaxInputBits) {
+		buttons &= (1ULL << kBits) - 1;
+	}
+	state->buttons = buttons;
+
+	if constexpr (kAxes) {
+		DecodeAxes(state);
+	}
+}
+} // namespace slask_spy
+
+#endif // FRAME_DECODER_H
@@ -0,0 +1,226 @@
+#ifndef FRAME_PARSER_H
+#define FRAME_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace com_ports {
+// Legacy frames send every input bit as its own byte followed by the
+// delimiter. Packed frames carry the same bits eight to a byte, lowest bit
+// first, as kPackedSync, a sequence number, the payload and a CRC-8 over the
+// sequence number and payload. Legacy bytes may be any value, kPackedSync
+// included, so only the CRC tells the two formats apart.
+enum class FrameFormat : uint8_t { kLegacy, kPacked };
+
+constexpr uint8_t kPackedSync{0xA5};
+// Sync, sequence and CRC bytes around the payload
+constexpr size_t kPackedOverhead{3};
+// Sent by the host after connecting, firmware that understands it switches
+// to packed frames and anything else keeps sending legacy frames
+constexpr char kPackedHandshake[6]{'S', 'S', 'P', 'Y', '1', '\n'};
+
+// CRC-8 with polynomial 0x07
+uint8_t Crc8(uint8_t const *data, size_t size);
+
+// A complete frame as handed to the data callback, data points into the
+// parser ring and is only valid during the callback. Legacy data holds one
+// byte per bit, packed data only the payload.
+struct Frame {
+	char *data;
+	// Monotonic time the bytes were read from the device
+	uint64_t arrival_ns;
+	FrameFormat format;
+	// Packed frames only
+	uint8_t sequence;
+};
+
+// Streaming parser for delimiter terminated frames of a fixed size.
+// Reads are done straight into the ring through WriteBegin/Commit and every
+// complete frame is handed to the callback in place, without copying.
+// A frame is only accepted when exactly kFrameSize bytes (delimiter
+// included) separate it from the previous delimiter, anything else is
+// dropped and counted as a resync. The payload itself is not checked,
+// every byte decodes as a bit (see PackFrameBits) and the delimiter cannot
+// appear inside an accepted frame.
+//
+// With packed detection enabled the first valid packed frame switches the
+// parser to the packed format until Clear. Packed frames are located by
+// their sync byte and only accepted when the CRC matches, a mismatch counts
+// as corrupt. A legacy frame starting with kPackedSync passes the CRC about
+// once in 256 tries and is then taken for packed, which is why only ports
+// sending the handshake enable detection.
+//
+// The counters are totals for the parser's lifetime and only safe to read
+// on the thread that parses.
+class FrameParser {
+public:
+	FrameParser(size_t frame_size, char delimiter = 0x0A);
+	~FrameParser();
+
+	FrameParser(FrameParser const &) = delete;
+	FrameParser &operator=(FrameParser const &) = delete;
+
+	char *WriteBegin();
+	size_t WriteCapacity() const;
+	void Commit(size_t bytes);
+	// Also drops back to the legacy format
+	void Clear();
+	void SetPackedDetection(bool enabled) { detect_packed_ = enabled; }
+
+	size_t FrameSize() const { return kFrameSize; }
+	char Delimiter() const { return kDelimiter; }
+	size_t PayloadBits() const { return kFrameSize - 1; }
+	FrameFormat Format() const { return format_; }
+	uint64_t ResyncCount() const { return resyncs_; }
+	uint64_t CorruptCount() const { return corrupt_; }
+	uint64_t BytesCommitted() const { return bytes_; }
+
+	// on_frame(char *data, FrameFormat format, uint8_t sequence)
+	template<typename Callback> size_t Parse(Callback &&on_frame)
+	{
+		size_t frames{0};
+		while (read_pos_ < write_pos_) {
+			bool const progressed{
+				format_ == FrameFormat::kPacked
+					? ParsePacked(on_frame, &frames)
+					: ParseLegacy(on_frame, &frames)};
+			if (!progressed) {
+				break;
+			}
+		}
+
+		if (read_pos_ == write_pos_) {
+			read_pos_ = 0;
+			write_pos_ = 0;
+		}
+		return frames;
+	}
+
+private:
+	void Compact();
+	bool PackedValid(char const *start) const;
+	// Moves the read position to the next sync byte in the next length
+	// bytes, returns false when there is none
+	bool SkipToSync(size_t length);
+
+	// Each step consumes at most one frame, false means it needs more data
+	template<typename Callback>
+	bool ParseLegacy(Callback &on_frame, size_t *frames)
+	{
+		char *const start{buffer_ + read_pos_};
+		size_t const available{write_pos_ - read_pos_};
+
+		if (detect_packed_ && !discarding_ &&
+		    static_cast<uint8_t>(*start) == kPackedSync) {
+			if (available < kPackedSize) {
+				return false;
+			}
+			if (PackedValid(start)) {
+				format_ = FrameFormat::kPacked;
+				return true;
+			}
+		}
+
+		char *const delimiter{static_cast<char *>(
+			memchr(start, kDelimiter, available))};
+
+		if (delimiter == nullptr) {
+			// No delimiter within a frame length, whatever we have
+			// can never become a valid frame
+			if (available >= kFrameSize) {
+				if (!discarding_) {
+					++resyncs_;
+				}
+				if (detect_packed_ && SkipToSync(available)) {
+					discarding_ = false;
+					return true;
+				}
+				discarding_ = true;
+				read_pos_ = write_pos_;
+			}
+			return false;
+		}
+
+		size_t const length{static_cast<size_t>(delimiter - start) + 1};
+
+		if (discarding_) {
+			discarding_ = false;
+			read_pos_ += length;
+			return true;
+		}
+
+		if (length != kFrameSize) {
+			++resyncs_;
+			// The firmware may have switched format mid-frame
+			if (!(detect_packed_ && SkipToSync(length))) {
+				read_pos_ += length;
+			}
+			return true;
+		}
+
+		read_pos_ += length;
+		on_frame(start, FrameFormat::kLegacy, uint8_t{0});
+		++*frames;
+		return true;
+	}
+
+	template<typename Callback>
+	bool ParsePacked(Callback &on_frame, size_t *frames)
+	{
+		char *const start{buffer_ + read_pos_};
+		size_t const available{write_pos_ - read_pos_};
+
+		if (static_cast<uint8_t>(*start) != kPackedSync) {
+			if (!discarding_) {
+				++resyncs_;
+				discarding_ = true;
+			}
+			if (!SkipToSync(available)) {
+				read_pos_ = write_pos_;
+				return false;
+			}
+			return true;
+		}
+
+		if (available < kPackedSize) {
+			return false;
+		}
+
+		if (!PackedValid(start)) {
+			// Could be payload that looks like a sync byte, search
+			// again from the next byte
+			if (!discarding_) {
+				++corrupt_;
+				discarding_ = true;
+			}
+			++read_pos_;
+			return true;
+		}
+
+		discarding_ = false;
+		read_pos_ += kPackedSize;
+		on_frame(start + 2, FrameFormat::kPacked,
+			 static_cast<uint8_t>(start[1]));
+		++*frames;
+		return true;
+	}
+
+	size_t const kFrameSize;
+	size_t const kPackedSize;
+	size_t const kCapacity;
+	char const kDelimiter;
+	char *buffer_;
+	size_t read_pos_;
+	size_t write_pos_;
+	bool discarding_;
+	bool detect_packed_;
+	FrameFormat format_;
+	uint64_t resyncs_;
+	uint64_t corrupt_;
+	uint64_t bytes_;
+};
+
+} // namespace com_ports
+
+#endif // FRAME_PARSER_H
@@ -0,0 +1,43 @@
+#ifndef HOTPLUG_MONITOR_H
+#define HOTPLUG_MONITOR_H
+
+#include <functional>
+
+namespace com_ports {
+// Reports serial devices appearing. On Linux /dev is watched with inotify,
+// the owner waits on Handle and calls Drain, which calls on_arrival when a
+// tty node was created or changed. On Windows on_arrival is called from a
+// system thread for every new COM port interface. Elsewhere it never fires.
+// With report_removals set devices going away are reported the same way.
+class HotplugMonitor {
+public:
+	using ArrivalCallback = std::function<void()>;
+
+	explicit HotplugMonitor(ArrivalCallback const &on_arrival,
+				bool report_removals = false);
+	~HotplugMonitor();
+
+	HotplugMonitor(HotplugMonitor const &) = delete;
+	HotplugMonitor &operator=(HotplugMonitor const &) = delete;
+
+#ifdef __linux__
+	int Handle() const { return inotify_fd_; }
+	void Drain();
+#endif
+
+	// Windows callback trampoline, not for general use
+	void NotifyArrival() const { on_arrival_(); }
+	bool ReportsRemovals() const { return kReportRemovals; }
+
+private:
+	ArrivalCallback const on_arrival_;
+	bool const kReportRemovals;
+#ifdef __linux__
+	int inotify_fd_;
+#elif defined(_WIN32)
+	void *notification_;
+#endif
+};
+} // namespace com_ports
+
+#endif // HOTPLUG_MONITOR_H
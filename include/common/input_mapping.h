@@ -0,0 +1,103 @@
+#ifndef INPUT_MAPPING_H
+#define INPUT_MAPPING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace slask_spy {
+// Skin element name and the frame bits it reads, axes are eight bits sent
+// most significant bit first
+struct InputMapping {
+	std::string_view name;
+	int32_t bit;
+	int32_t bits;
+};
+
+constexpr InputMapping Button(std::string_view name, int32_t bit)
+{
+	return InputMapping{name, bit, 1};
+}
+
+constexpr InputMapping Axis(std::string_view name, int32_t bit)
+{
+	return InputMapping{name, bit, 8};
+}
+
+// Mapping of a controller, sorted by name at compile time so a lookup is a
+// binary search without hashing or static initialization. Lookups of
+// constant names can be evaluated at compile time.
+template<size_t N> class MappingTable {
+public:
+	constexpr MappingTable(InputMapping const (&entries)[N]) : entries_{}
+	{
+		for (size_t i{0}; i < N; ++i) {
+			InputMapping const entry{entries[i]};
+			size_t j{i};
+			for (; j > 0 && entry.name < entries_[j - 1].name; --j) {
+				entries_[j] = entries_[j - 1];
+			}
+			entries_[j] = entry;
+		}
+	}
+
+	// First frame bit of the input, -1 when the name is unknown
+	constexpr int32_t Find(std::string_view name) const
+	{
+		size_t low{0};
+		size_t high{N};
+		while (low < high) {
+			size_t const middle{low + (high - low) / 2};
+			if (entries_[middle].name < name) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+		if (low < N && entries_[low].name == name) {
+			return entries_[low].bit;
+		}
+		return -1;
+	}
+
+	// Every input lies within the payload of a data_bytes frame and
+	// axes start on a byte boundary, see ControllerState::Axis
+	constexpr bool FitsFrame(size_t data_bytes) const
+	{
+		for (InputMapping const &entry : entries_) {
+			if (entry.bit < 0 ||
+			    static_cast<size_t>(entry.bit + entry.bits) >
+				    data_bytes - 1 ||
+			    (entry.bits > 1 && entry.bit % 8 != 0)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	constexpr bool HasAxes() const
+	{
+		for (InputMapping const &entry : entries_) {
+			if (entry.bits > 1) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	constexpr bool NamesUnique() const
+	{
+		for (size_t i{1}; i < N; ++i) {
+			if (entries_[i - 1].name == entries_[i].name) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	InputMapping entries_[N];
+};
+} // namespace slask_spy
+
+#endif // INPUT_MAPPING_H
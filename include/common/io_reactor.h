@@ -0,0 +1,78 @@
+#ifndef IO_REACTOR_H
+#define IO_REACTOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "com_ports.h"
+#include "hotplug_monitor.h"
+#include "wake_handle.h"
+
+namespace com_ports {
+// Drives every open device from one thread. On Linux the device handles are
+// multiplexed with epoll and service deadlines become the epoll timeout, so
+// idle ports cost nothing and dozens of them fit on one core. Elsewhere each
+// device gets a thread running Tick, which Remove interrupts.
+//
+// Serial device arrivals reported by the HotplugMonitor are passed on to
+// the devices, so a disconnected one reconnects right away. Off Linux only
+// devices waiting to reconnect are told and have their Tick interrupted.
+//
+// Frames are dispatched on the reactor thread. Remove blocks until the
+// device is no longer being dispatched, after which it can be deleted.
+class IOReactor {
+public:
+	static IOReactor &Instance();
+
+	IOReactor(IOReactor const &) = delete;
+	IOReactor &operator=(IOReactor const &) = delete;
+
+	void Add(Device *device);
+	void Remove(Device *device);
+
+private:
+	IOReactor();
+	~IOReactor();
+
+	void Stop();
+	void NotifyDeviceArrival();
+
+#ifdef __linux__
+	struct Entry {
+		uint64_t id;
+		Device *device;
+		int registered_handle;
+		uint64_t deadline_ns;
+	};
+
+	void Run();
+	void UpdateRegistration(Entry &entry);
+	Entry *Find(uint64_t id);
+
+	int epoll_fd_;
+	WakeHandle wake_;
+	uint64_t next_id_;
+	bool running_;
+	std::vector<Entry> entries_;
+	std::thread *thread_;
+	// Held while dispatching, Add and Remove take it to edit entries_
+	std::mutex mutex_;
+#else
+	struct Worker {
+		Device *device;
+		std::thread *thread;
+		std::atomic<bool> running;
+	};
+
+	std::vector<Worker *> workers_;
+#endif
+	// Serializes Add and Remove so thread start and stop never overlap
+	std::mutex lifecycle_mutex_;
+	HotplugMonitor *hotplug_;
+};
+} // namespace com_ports
+
+#endif // IO_REACTOR_H
@@ -0,0 +1,68 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace slask_spy {
+
+struct LatencySnapshot {
+	std::vector<uint32_t> counts;
+	uint64_t total;
+	uint64_t max_ns;
+
+	// Highest value within the bucket holding the given quantile, 0-1
+	uint64_t Percentile(double quantile) const;
+	// Only what was recorded after previous was taken, max_ns is then the
+	// bucket bound of the highest value in the interval
+	LatencySnapshot Since(LatencySnapshot const &previous) const;
+};
+
+// Log-linear histogram in the style of HdrHistogram, every power of two is
+// split into 32 buckets which keeps values within ~3% up to ~68 s. Record
+// must only be called from one thread, snapshots can be taken from any.
+class LatencyHistogram {
+public:
+	static constexpr int32_t kSubBucketBits{6};
+	static constexpr int32_t kMaxValueBits{36};
+	static constexpr size_t kHalfSubBuckets{1 << (kSubBucketBits - 1)};
+	static constexpr size_t kBucketCount{
+		(kMaxValueBits - kSubBucketBits + 2) * kHalfSubBuckets};
+
+	void Record(uint64_t value_ns);
+	LatencySnapshot Snapshot() const;
+
+	static size_t BucketIndex(uint64_t value_ns);
+	static uint64_t BucketUpperBound(size_t index);
+
+private:
+	std::atomic<uint32_t> counts_[kBucketCount]{};
+	std::atomic<uint64_t> total_{0};
+	std::atomic<uint64_t> max_ns_{0};
+};
+
+// Per source latencies of every frame, measured from the moment its bytes
+// were read from the device
+struct LatencyStats {
+	// Until the frame has been packed, recorded on the reading thread
+	LatencyHistogram decode;
+	// Until the render thread consumed it, recorded on the render thread
+	LatencyHistogram render;
+};
+
+// Logs the latencies of the last interval, keeps the previous snapshots so
+// call it from a single thread
+class LatencyReporter {
+public:
+	void Log(char const *source_name, LatencyStats const &stats);
+
+private:
+	LatencySnapshot previous_decode_{};
+	LatencySnapshot previous_render_{};
+};
+
+} // namespace slask_spy
+
+#endif // LATENCY_HISTOGRAM_H
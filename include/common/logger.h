@@ -1,107 +1,142 @@
 #ifndef SLASK_SPY_INCLUDE_COMMON_LOGGER
 #define SLASK_SPY_INCLUDE_COMMON_LOGGER
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdarg>
-#include <iostream>
-#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
 
+// Messages below this level are compiled out, 0 keeps everything, 1 drops
+// Info, 2 drops Warn as well and 3 disables logging
+#ifndef SLASK_SPY_LOG_LEVEL
+#define SLASK_SPY_LOG_LEVEL 0
+#endif
+
+enum class LogLevel : uint8_t { kInfo = 0, kWarn, kError, kNone };
+
+constexpr LogLevel kMinLogLevel{static_cast<LogLevel>(SLASK_SPY_LOG_LEVEL)};
+
+// Receives complete messages on the logger's flush thread
 class LoggerImpl {
 public:
-	virtual void Info(const char *format) const = 0;
-	virtual void Warn(const char *format) const = 0;
-	virtual void Error(const char *format) const = 0;
+	virtual ~LoggerImpl() = default;
+
+	virtual void Info(const char *message) const = 0;
+	virtual void Warn(const char *message) const = 0;
+	virtual void Error(const char *message) const = 0;
 };
 
+// Logging never allocates or blocks the caller. A message is formatted
+// once into a fixed size record of a bounded lock-free ring, which the flush
+// thread hands to the LoggerImpl. Messages that do not fit in a record are
+// truncated and messages arriving while the ring is full are dropped and
+// counted.
+//
+// Each format string may log kRateBurst messages per kRateWindow, the
+// number suppressed beyond that is reported with the next one let through.
+// Format strings are told apart by address, each claims a rate slot of its
+// own and only those finding no free slot share the last one.
 class Logger {
 public:
-	static void CreateContext(LoggerImpl *logger_implementation)
-	{
-		Get().impl_ = logger_implementation;
-	}
+	// Starts the flush thread, implementations are owned by the logger
+	static void CreateContext(LoggerImpl *logger_implementation);
+	// Flushes what is queued and stops the flush thread. Call before the
+	// module unloads, joining from a static destructor is not safe
+	// everywhere.
+	static void DestroyContext();
 
-	static Logger &Get()
-	{
-		static Logger inst{};
-		return inst;
-	}
+	static Logger &Get();
 
 	static void Info(const char *format, ...)
 	{
-		Logger const &logger{Logger::Get()};
-		if (logger.impl_ == nullptr) {
-			std::cerr << "Logger used without initializing context"
-				  << std::endl;
-			return;
+		if constexpr (kMinLogLevel <= LogLevel::kInfo) {
+			va_list args{};
+			va_start(args, format);
+			Get().Write(LogLevel::kInfo, format, args);
+			va_end(args);
 		}
-
-		va_list args{};
-		va_start(args, format);
-		const int32_t size =
-			vsnprintf(nullptr, 0, format, args) + sizeof('\0');
-		va_end(args);
-
-		char *buffer = new char[size];
-		va_start(args, format);
-		vsnprintf(buffer, size, format, args);
-		logger.impl_->Info(buffer);
-		va_end(args);
 	}
 
 	static void Warn(const char *format, ...)
 	{
-		Logger const &logger{Logger::Get()};
-		if (logger.impl_ == nullptr) {
-			std::cerr << "Logger used without initializing context"
-				  << std::endl;
-			return;
+		if constexpr (kMinLogLevel <= LogLevel::kWarn) {
+			va_list args{};
+			va_start(args, format);
+			Get().Write(LogLevel::kWarn, format, args);
+			va_end(args);
 		}
-
-		va_list args{};
-		va_start(args, format);
-		const int32_t size =
-			vsnprintf(nullptr, 0, format, args) + sizeof('\0');
-		va_end(args);
-
-		char *buffer = new char[size];
-		va_start(args, format);
-		vsnprintf(buffer, size, format, args);
-		logger.impl_->Warn(buffer);
-		va_end(args);
 	}
 
 	static void Error(const char *format, ...)
 	{
-		Logger const &logger{Logger::Get()};
-		if (logger.impl_ == nullptr) {
-			std::cerr << "Logger used without initializing context"
-				  << std::endl;
-			return;
+		if constexpr (kMinLogLevel <= LogLevel::kError) {
+			va_list args{};
+			va_start(args, format);
+			Get().Write(LogLevel::kError, format, args);
+			va_end(args);
 		}
-
-		va_list args{};
-		va_start(args, format);
-		const int32_t size =
-			vsnprintf(nullptr, 0, format, args) + sizeof('\0');
-		va_end(args);
-
-		char *buffer = new char[size];
-		va_start(args, format);
-		vsnprintf(buffer, size, format, args);
-		logger.impl_->Error(buffer);
-		va_end(args);
 	}
 
-	~Logger()
-	{
-		if (impl_ != nullptr) {
-			delete impl_;
-		}
-	}
+	Logger(Logger const &) = delete;
+	Logger &operator=(Logger const &) = delete;
 
 private:
-	Logger() : impl_{nullptr} {}
-
-	LoggerImpl const *impl_;
+	static constexpr size_t kRecordSize{256};
+	// Power of two
+	static constexpr size_t kRingRecords{256};
+	static constexpr size_t kRateSlots{256};
+	// Slots tried from the one an address hashes to
+	static constexpr size_t kRateProbes{8};
+	static constexpr uint32_t kRateBurst{10};
+	static constexpr uint64_t kRateWindowNs{1'000'000'000};
+
+	struct RateSlot {
+		// Claimed by the first format hashing here, never released
+		std::atomic<const char *> format;
+		// Window in the upper 40 bits, message count in the lower 24
+		std::atomic<uint64_t> state;
+	};
+
+	struct Record {
+		// Vyukov sequence, equals the ring position while free and the
+		// position plus one once published
+		std::atomic<uint64_t> sequence;
+		LogLevel level;
+		uint32_t suppressed;
+		char text[kRecordSize - 16];
+	};
+
+	Logger();
+	~Logger();
+
+	void Write(LogLevel level, const char *format, va_list args);
+	// Returns false when the message is over its rate, otherwise the
+	// number suppressed since the last one let through
+	bool Admit(const char *format, uint64_t now_ns, uint32_t *suppressed);
+	RateSlot &FindRateSlot(const char *format);
+	void Run();
+	// Flush thread only, returns whether anything was written
+	bool Flush();
+	void Emit(LogLevel level, const char *message) const;
+	void Stop();
+
+	std::atomic<LoggerImpl const *> impl_;
+	Record *ring_;
+	std::atomic<uint64_t> enqueue_pos_;
+	// Flush thread only
+	uint64_t dequeue_pos_;
+	std::atomic<uint64_t> dropped_;
+	// The last one is shared by formats without a slot of their own
+	RateSlot rate_[kRateSlots + 1];
+
+	std::thread *thread_;
+	std::atomic<bool> running_;
+	// Only held by the flush thread and Stop, writers notify without it
+	std::mutex mutex_;
+	std::condition_variable wake_;
 };
 
 #endif // SLASK_SPY_INCLUDE_COMMON_LOGGER
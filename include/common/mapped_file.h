@@ -0,0 +1,32 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace slask_spy {
+// Read-only view of a whole file, memory mapped so parsers read the page
+// cache directly instead of copying through a stream. An empty file gives
+// an empty view.
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	// False when the file cannot be opened or mapped
+	bool Open(std::string const &path);
+	std::string_view Contents() const { return {data_, size_}; }
+
+private:
+	void Close();
+
+	char const *data_;
+	size_t size_;
+};
+} // namespace slask_spy
+
+#endif // MAPPED_FILE_H
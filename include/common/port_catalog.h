@@ -0,0 +1,58 @@
+#ifndef PORT_CATALOG_H
+#define PORT_CATALOG_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "com_ports.h"
+#include "hotplug_monitor.h"
+#include "wake_handle.h"
+
+namespace com_ports {
+// Keeps the list of serial ports current on a background thread, so the UI
+// never waits for an enumeration. The list is rebuilt whenever the
+// HotplugMonitor reports a port appearing or going away, and every
+// kRefreshInterval in case a change was missed.
+//
+// Ports returns the latest list without touching any device, it is empty
+// until the first enumeration after Start has finished.
+class PortCatalog {
+public:
+	using PortList = std::shared_ptr<std::vector<ComPortData> const>;
+
+	static PortCatalog &Instance();
+
+	PortCatalog(PortCatalog const &) = delete;
+	PortCatalog &operator=(PortCatalog const &) = delete;
+
+	void Start();
+	// Call before the module unloads, joining from a static destructor
+	// is not safe everywhere
+	void Stop();
+
+	PortList Ports() const;
+	// Whether Ports holds the result of an enumeration yet
+	bool Enumerated() const { return enumerated_; }
+
+private:
+	PortCatalog();
+	~PortCatalog();
+
+	void Run();
+	// Returns early on hotplug events and Stop
+	void Wait();
+
+	mutable std::mutex mutex_;
+	PortList ports_;
+	std::atomic<bool> enumerated_;
+	WakeHandle wake_;
+	std::atomic<bool> running_;
+	std::thread *thread_;
+	HotplugMonitor *hotplug_;
+};
+} // namespace com_ports
+
+#endif // PORT_CATALOG_H
@@ -0,0 +1,35 @@
+#ifndef RECONNECT_BACKOFF_H
+#define RECONNECT_BACKOFF_H
+
+#include <cstdint>
+
+namespace com_ports {
+// Schedules reconnect attempts for a device that went away. The first
+// attempt is immediate, after that the delay doubles from kMinDelay up to
+// kMaxDelay. A device arrival reported by the OS makes the next attempt due
+// right away, so the delay only matters when there is no hotplug support.
+// Reading thread only.
+class ReconnectBackoff {
+public:
+	static constexpr uint64_t kMinDelay{50'000'000};
+	static constexpr uint64_t kMaxDelay{2'000'000'000};
+
+	bool Disconnected() const { return disconnected_; }
+	uint32_t Attempts() const { return attempts_; }
+	uint64_t NextAttemptNs() const { return next_attempt_ns_; }
+	bool Due(uint64_t now_ns) const { return now_ns >= next_attempt_ns_; }
+
+	void Lost(uint64_t now_ns);
+	void AttemptFailed(uint64_t now_ns);
+	void DeviceArrived(uint64_t now_ns);
+	void Restored();
+
+private:
+	bool disconnected_{false};
+	uint32_t attempts_{0};
+	uint64_t delay_ns_{kMinDelay};
+	uint64_t next_attempt_ns_{0};
+};
+} // namespace com_ports
+
+#endif // RECONNECT_BACKOFF_H
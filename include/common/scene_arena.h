@@ -0,0 +1,91 @@
+#ifndef SCENE_ARENA_H
+#define SCENE_ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace slask_spy {
+// Bump allocator for everything that lives exactly as long as one scene:
+// the skin settings, the graphics wrapper and the scene arrays. Reset runs
+// the destructors of created objects in reverse order and rewinds the
+// block in one go, the block itself is kept for the next scene.
+//
+// It is also a memory resource, so the containers inside those objects
+// can take their memory from it. Deallocating is a no-op, the memory comes
+// back with Reset.
+//
+// Allocations that do not fit go to overflow blocks. Reset frees those and
+// grows the block to the high water mark, so a rebuilt scene of the same
+// skin fits in one block.
+class SceneArena : public std::pmr::memory_resource {
+public:
+	explicit SceneArena(size_t capacity = 0);
+	~SceneArena() override;
+
+	SceneArena(SceneArena const &) = delete;
+	SceneArena &operator=(SceneArena const &) = delete;
+
+	void *Allocate(size_t size, size_t alignment);
+	void Reset();
+
+	size_t Capacity() const { return capacity_; }
+	size_t Used() const { return used_; }
+
+	// Value initialized, the elements are never destroyed
+	template<typename T> T *AllocateArray(size_t count)
+	{
+		static_assert(std::is_trivially_destructible_v<T>);
+		if (count == 0) {
+			return nullptr;
+		}
+		T *const array{static_cast<T *>(
+			Allocate(sizeof(T) * count, alignof(T)))};
+		for (size_t i{0}; i < count; ++i) {
+			new (array + i) T{};
+		}
+		return array;
+	}
+
+	// Destroyed by Reset, friend SceneArena to keep a constructor private
+	template<typename T, typename... Args> T *Create(Args &&...args)
+	{
+		void *const memory{Allocate(sizeof(T), alignof(T))};
+		T *const object{new (memory) T(std::forward<Args>(args)...)};
+		if constexpr (!std::is_trivially_destructible_v<T>) {
+			void *const node{Allocate(sizeof(Finalizer),
+						  alignof(Finalizer))};
+			finalizers_ = new (node) Finalizer{
+				[](void *it) { static_cast<T *>(it)->~T(); },
+				object, finalizers_};
+		}
+		return object;
+	}
+
+private:
+	void *do_allocate(size_t size, size_t alignment) override;
+	void do_deallocate(void *memory, size_t size,
+			   size_t alignment) override;
+	bool do_is_equal(
+		std::pmr::memory_resource const &other) const noexcept override;
+
+	struct Finalizer {
+		void (*destroy)(void *object);
+		void *object;
+		Finalizer *next;
+	};
+
+	std::byte *block_;
+	size_t capacity_;
+	size_t used_;
+	// Bytes requested since the last Reset, overflow included
+	size_t requested_;
+	Finalizer *finalizers_;
+	std::vector<std::byte *> overflow_;
+};
+} // namespace slask_spy
+
+#endif // SCENE_ARENA_H
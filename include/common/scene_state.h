@@ -0,0 +1,97 @@
+#ifndef SCENE_STATE_H
+#define SCENE_STATE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "scene_arena.h"
+
+namespace slask_spy {
+struct DrawRegion {
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+};
+
+// Render state of every skin element as parallel arrays indexed by element.
+// The graphics backend allocates the arrays for the whole scene from its
+// arena and adds the elements while setting it up, the viewer writes
+// visibility, translations and regions in ApplyLatestState and the backend
+// then draws them in one linear pass on the same thread.
+struct SceneState {
+	static constexpr uint32_t kFlipX{1U << 0};
+	static constexpr uint32_t kFlipY{1U << 1};
+
+	// Room for capacity elements, owned by the arena
+	void Allocate(SceneArena &arena, size_t element_capacity)
+	{
+		size_t const words{(element_capacity + 63) / 64};
+		visible = arena.AllocateArray<uint64_t>(words);
+		translation_x = arena.AllocateArray<float>(element_capacity);
+		translation_y = arena.AllocateArray<float>(element_capacity);
+		regions = arena.AllocateArray<DrawRegion>(element_capacity);
+		origin_x = arena.AllocateArray<float>(element_capacity);
+		origin_y = arena.AllocateArray<float>(element_capacity);
+		scale_x = arena.AllocateArray<float>(element_capacity);
+		scale_y = arena.AllocateArray<float>(element_capacity);
+		full_regions =
+			arena.AllocateArray<DrawRegion>(element_capacity);
+		flips = arena.AllocateArray<uint32_t>(element_capacity);
+		count = 0;
+		capacity = element_capacity;
+	}
+
+	// Returns the index of the new element, there has to be room for it
+	uint32_t Add(float x, float y, float element_scale_x,
+		     float element_scale_y, DrawRegion const &region,
+		     uint32_t flip, bool is_visible)
+	{
+		uint32_t const element{static_cast<uint32_t>(count++)};
+		SetVisible(element, is_visible);
+		translation_x[element] = x;
+		translation_y[element] = y;
+		regions[element] = region;
+		origin_x[element] = x;
+		origin_y[element] = y;
+		scale_x[element] = element_scale_x;
+		scale_y[element] = element_scale_y;
+		full_regions[element] = region;
+		flips[element] = flip;
+		return element;
+	}
+
+	size_t Size() const { return count; }
+
+	bool Visible(uint32_t element) const
+	{
+		return (visible[element / 64] >> (element % 64)) & 1U;
+	}
+
+	void SetVisible(uint32_t element, bool is_visible)
+	{
+		uint64_t const bit{1ULL << (element % 64)};
+		uint64_t &word{visible[element / 64]};
+		word = is_visible ? word | bit : word & ~bit;
+	}
+
+	size_t count{0};
+	size_t capacity{0};
+
+	// Written by the viewer
+	uint64_t *visible{nullptr};
+	float *translation_x{nullptr};
+	float *translation_y{nullptr};
+	DrawRegion *regions{nullptr};
+
+	// Fixed once added
+	float *origin_x{nullptr};
+	float *origin_y{nullptr};
+	float *scale_x{nullptr};
+	float *scale_y{nullptr};
+	DrawRegion *full_regions{nullptr};
+	uint32_t *flips{nullptr};
+};
+} // namespace slask_spy
+
+#endif // SCENE_STATE_H
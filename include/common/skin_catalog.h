@@ -0,0 +1,49 @@
+#ifndef SKIN_CATALOG_H
+#define SKIN_CATALOG_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "skin_index.h"
+#include "skin_settings.h"
+
+namespace slask_spy {
+// The skins found in each skin directory, shared by every source. A refresh
+// builds a new list and publishes it whole, so readers on any thread keep
+// the list they hold, and the SkinData in it, until they let it go. The
+// SkinData of an unchanged skin is shared across refreshes.
+class SkinCatalog {
+public:
+	using SkinMap = std::unordered_map<
+		ViewerType,
+		std::map<std::string, std::shared_ptr<SkinData const>>>;
+	using SkinList = std::shared_ptr<SkinMap const>;
+
+	// index_path is handed to the SkinIndex, see there
+	explicit SkinCatalog(std::string index_path);
+
+	SkinCatalog(SkinCatalog const &) = delete;
+	SkinCatalog &operator=(SkinCatalog const &) = delete;
+
+	// Rescans skins_directory and publishes the result, which is empty
+	// when the directory does not exist or holds no skins
+	SkinList Refresh(std::string const &skins_directory);
+	// The latest list of skins_directory, rescanned first when there is
+	// none yet or it was empty
+	SkinList Get(std::string const &skins_directory);
+
+private:
+	// Serializes refreshes, the index is not thread safe
+	std::mutex refresh_mutex_;
+	SkinIndex index_;
+
+	std::mutex mutex_;
+	// Keyed by skin directory
+	std::map<std::string, SkinList> skins_;
+};
+} // namespace slask_spy
+
+#endif // SKIN_CATALOG_H
@@ -0,0 +1,73 @@
+#ifndef SKIN_INDEX_H
+#define SKIN_INDEX_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "skin_settings.h"
+
+namespace slask_spy {
+// The skin.xml headers of skin libraries, persisted to a file so a rescan
+// only parses what changed. Every library directory keeps entries of its
+// own, sources using different libraries do not rescan each other's.
+// Skins are keyed by the size and modification time of their skin.xml.
+// Folders are keyed by their own modification time, which changes when
+// entries are added or removed, so an unchanged folder is not listed
+// again and only its known subfolders are checked.
+// A directory holding a skin.xml is a skin and its subfolders are assets,
+// they are never descended into. Directory symlinks are followed, except
+// into a folder that is also above them.
+//
+// Folders are listed and skins parsed in parallel on the WorkPool, the
+// results are merged into the ordered index so the catalog does not
+// depend on which thread finished first.
+class SkinIndex {
+public:
+	struct Entry {
+		// skin.xml for skins, the directory itself for folders
+		int64_t mtime;
+		uint64_t size;
+		bool is_skin;
+		// Skins only, types is empty when skin.xml is invalid. The
+		// data is kept while skin.xml is unchanged, catalogs share it.
+		std::vector<ViewerType> types;
+		std::shared_ptr<SkinData const> data;
+		// Folders only, names of the subdirectories
+		std::vector<std::string> children;
+	};
+
+	// The index is read from and saved to index_path, an empty path
+	// keeps it in memory only
+	explicit SkinIndex(std::string index_path);
+
+	// Brings the index up to date with skins_directory and saves it when
+	// anything changed. False when the directory does not exist.
+	bool Refresh(std::string const &skins_directory);
+
+	// The entries of skins_directory as of its last refresh, keyed by
+	// directory path. The catalog key of a skin is its path with a
+	// trailing '/'.
+	std::map<std::string, Entry> const &
+	Entries(std::string const &skins_directory) const;
+
+private:
+	struct ScanState;
+
+	// Runs on the WorkPool, every subfolder is scanned as its own task.
+	// ancestors holds the canonical paths of the folders above path.
+	static void Scan(std::string const &path, bool is_root,
+			 std::vector<std::string> ancestors, ScanState &state);
+	void Load();
+	void Save() const;
+
+	std::string const kIndexPath;
+	bool loaded_;
+	// Keyed by library directory
+	std::map<std::string, std::map<std::string, Entry>> roots_;
+};
+} // namespace slask_spy
+
+#endif // SKIN_INDEX_H
@@ -2,6 +2,8 @@
 #define SKIN_SETTINGS_H
 
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <string>
 #include <string_view>
 #include <tuple>
@@ -17,7 +19,8 @@ struct CommonSetting {
 	int32_t y;
 	int32_t width;
 	int32_t height;
-	std::string image;
+	// Owned by the SkinSettings holding the setting
+	std::string_view image;
 };
 
 struct ButtonSetting : public CommonSetting {
@@ -48,39 +51,70 @@ struct SkinData {
 };
 
 enum class ViewerType;
+class CustomProtocol;
+class SceneArena;
+class SkinIndex;
+struct XmlTag;
 class SkinSettings {
 public:
 	static SkinSettings *LoadSkinSettings(std::string_view skin_directory,
 					      ViewerType type);
+	// Created in arena and destroyed by its Reset, which also releases a
+	// skin that failed to load. Its elements, image names and protocol
+	// are allocated from arena as well.
+	static SkinSettings *LoadSkinSettings(std::string_view skin_directory,
+					      ViewerType type,
+					      SceneArena &arena);
 
+	// Rebuilds skins from index, which only parses the skin.xml files
+	// that changed since its last refresh. The SkinData is shared with
+	// the index.
 	static bool FetchSkins(
-		std::string const &skins_directory,
-		std::unordered_map<ViewerType,
-				   std::map<std::string, SkinData *>> &skins);
-
-	std::vector<ButtonSetting> const &GetButtonSettings() const;
-	std::vector<StickSetting> const &GetStickSettings() const;
-	std::vector<AnalogSetting> const &GetAnalogSettings() const;
+		std::string const &skins_directory, SkinIndex &index,
+		std::unordered_map<
+			ViewerType,
+			std::map<std::string, std::shared_ptr<SkinData const>>>
+			&skins);
+
+	std::pmr::vector<ButtonSetting> const &GetButtonSettings() const;
+	std::pmr::vector<StickSetting> const &GetStickSettings() const;
+	std::pmr::vector<AnalogSetting> const &GetAnalogSettings() const;
 	std::string_view GetSkinPath() const;
+	// Layout from protocol.xml, only loaded for ViewerType::kCustom
+	CustomProtocol const *GetProtocol() const;
+
+	~SkinSettings();
 
 private:
-	SkinSettings(std::string_view skin_directory, ViewerType type);
-
-	bool CreateButtonSetting(std::string const &line);
-	bool CreateStickSetting(std::string const &line);
-	bool CreateBackgroundSetting(std::string const &line);
-	bool CreateAnalogSetting(std::string const &line);
-	static std::string GetAttributeValue(std::string const &line,
-					     std::string const &name);
+	friend class SceneArena;
+	friend class SkinIndex;
+
+	SkinSettings(std::string_view skin_directory, ViewerType type,
+		     std::pmr::memory_resource *upstream);
+
+	int32_t MappingIndex(std::string_view name) const;
+	// Log what is missing and return false on a bad element
+	bool CreateButtonSetting(XmlTag const &tag);
+	bool CreateStickSetting(XmlTag const &tag);
+	bool CreateAnalogSetting(XmlTag const &tag);
+	bool ReadCommonSetting(XmlTag const &tag, CommonSetting *common);
+	bool ReadInt(XmlTag const &tag, std::string_view name,
+		     int32_t *value) const;
+	bool ReadString(XmlTag const &tag, std::string_view name,
+			std::string_view *value) const;
 	static std::tuple<std::vector<ViewerType>, std::string, SkinData *>
 	GetSkinData(std::string_view skin_path);
 
 	bool valid_;
-	std::string const skin_path_;
+	// Everything below is allocated from it and only released with it,
+	// upstream is the arena or the heap
+	std::pmr::monotonic_buffer_resource pool_;
+	std::pmr::string const skin_path_;
 	ViewerType const type_;
-	std::vector<ButtonSetting> buttons_;
-	std::vector<StickSetting> sticks_;
-	std::vector<AnalogSetting> analogs_;
+	std::pmr::vector<ButtonSetting> buttons_;
+	std::pmr::vector<StickSetting> sticks_;
+	std::pmr::vector<AnalogSetting> analogs_;
+	CustomProtocol *protocol_;
 };
 
 } // namespace slask_spy
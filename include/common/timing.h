@@ -0,0 +1,17 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <chrono>
+#include <cstdint>
+
+namespace slask_spy {
+inline uint64_t MonotonicNanoseconds()
+{
+	return static_cast<uint64_t>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch())
+			.count());
+}
+} // namespace slask_spy
+
+#endif // TIMING_H
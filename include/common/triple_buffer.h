@@ -0,0 +1,54 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace slask_spy {
+
+// Single producer, single consumer snapshot exchange. The producer always
+// owns one buffer, the consumer another and the third is swapped between them
+// with a single atomic exchange, so neither side ever waits or sees a torn
+// value.
+template<typename T> class TripleBuffer {
+public:
+	// Producer side
+	T &WriteBuffer() { return buffers_[back_]; }
+
+	void Publish()
+	{
+		uint8_t const previous{middle_.exchange(
+			static_cast<uint8_t>(back_ | kDirtyBit),
+			std::memory_order_acq_rel)};
+		back_ = previous & kIndexMask;
+	}
+
+	// Consumer side, returns false when nothing new has been published
+	bool Fetch()
+	{
+		uint8_t const middle{middle_.load(std::memory_order_relaxed)};
+		if ((middle & kDirtyBit) == 0) {
+			return false;
+		}
+
+		uint8_t const previous{
+			middle_.exchange(front_, std::memory_order_acq_rel)};
+		front_ = previous & kIndexMask;
+		return true;
+	}
+
+	T const &ReadBuffer() const { return buffers_[front_]; }
+
+private:
+	static constexpr uint8_t kIndexMask{0x03};
+	static constexpr uint8_t kDirtyBit{0x04};
+
+	T buffers_[3]{};
+	alignas(64) std::atomic<uint8_t> middle_{1};
+	alignas(64) uint8_t back_{0};
+	alignas(64) uint8_t front_{2};
+};
+
+} // namespace slask_spy
+
+#endif // TRIPLE_BUFFER_H
@@ -2,36 +2,110 @@
 #define VIEWER_H
 
 #include <cstdint>
+#include <functional>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 
-#include "input_items.h"
+#include "controller_state.h"
+#include "latency_histogram.h"
+#include "scene_state.h"
+#include "skin_settings.h"
+#include "triple_buffer.h"
 
 namespace slask_spy {
-enum class ViewerType { kNull = 0, kN64, kGC };
+// Stored in settings, append new types at the end
+enum class ViewerType {
+	kNull = 0,
+	kN64,
+	kGC,
+	kNES,
+	kSNES,
+	kClassic,
+	kGBA,
+	// Layout read from the skin's protocol.xml, see CustomProtocol
+	kCustom
+};
+
+class SkinSettings;
 
 class Viewer {
 public:
-	static Viewer *CreateViewer(ViewerType type);
+	// Bit i is set when frame bit i differs from the previous frame
+	using ChangeCallback = std::function<void(
+		uint64_t changed_bits, ControllerState const &state)>;
+
+	// Table driven, see the registry in viewer.cpp. skin provides the
+	// layout of kCustom viewers.
+	static Viewer *CreateViewer(ViewerType type, SkinSettings const *skin);
 	static std::string StringFromType(ViewerType type);
 	static ViewerType TypeFromString(std::string_view type_string);
 	static int32_t GetMappingIndex(std::string_view name, ViewerType type);
 
 	virtual size_t GetDataBytesSize() const = 0;
+	virtual char GetDelimiter() const { return '\n'; }
 
-	void SetIncommingData(char *data);
-	void AssignButton(InputButton *button_item);
-	void AssignStick(InputStick *stick_item);
-	void AssignAnalog(InputAnalog *stick_item);
+	// Called on the reading thread for every frame, packs it into the
+	// controller state. Returns false when the frame is identical to the
+	// previous one, in which case nothing is published.
+	virtual bool SetIncommingData(char const *data,
+				      uint64_t arrival_ns) = 0;
+	// Same for a packed payload, see com_ports::FrameFormat
+	virtual bool SetIncommingPacked(uint8_t const *payload,
+					uint64_t arrival_ns) = 0;
+	// Called on the render thread, writes the bound scene elements whose
+	// inputs changed since the last call. Returns false when nothing new
+	// has arrived.
+	bool ApplyLatestState();
+	// Subscribers are called on the reading thread for every frame that
+	// changed, subscribe before the device starts delivering frames
+	void SubscribeChanges(ChangeCallback const &callback);
+	// Can be sampled from any thread
+	LatencyStats const &GetLatencyStats() const;
+
+	// Bindings are made while the backend sets up the scene, before the
+	// first ApplyLatestState. element is an index into scene.
+	void BindScene(SceneState *scene);
+	void BindButton(ButtonSetting const &setting, uint32_t element);
+	void BindStick(StickSetting const &setting, uint32_t element,
+		       float x_divisor, float y_divisor);
+	void BindAnalog(AnalogSetting const &setting, uint32_t element);
 
 	virtual ~Viewer() = default;
 
 protected:
-	virtual void SetStickData(char *data, InputStick *stick);
+	// axis_center is subtracted from stick axes before they are applied
+	explicit Viewer(int32_t axis_center) : kAxisCenter{axis_center} {}
+
+	bool PublishState(ControllerState &state, uint64_t arrival_ns);
+
+	int32_t const kAxisCenter;
+
+	TripleBuffer<ControllerState> state_buffer_{};
+	std::vector<ChangeCallback> change_callbacks_{};
+	LatencyStats latency_{};
+
+	// Reading thread only
+	ControllerState last_state_{};
+	bool published_{false};
+
+	// Render thread only
+	uint64_t applied_buttons_{0};
+	bool applied_{false};
 
-	std::vector<InputButton *> assigned_buttons_{};
-	std::vector<InputStick *> assigned_sticks_{};
-	std::vector<InputAnalog *> assigned_analogs_{};
+	// Bindings as parallel arrays, one entry per bound element
+	SceneState *scene_{nullptr};
+	std::vector<int32_t> button_bits_{};
+	std::vector<uint32_t> button_elements_{};
+	std::vector<int32_t> stick_x_bits_{};
+	std::vector<int32_t> stick_y_bits_{};
+	std::vector<float> stick_ranges_x_{};
+	std::vector<float> stick_ranges_y_{};
+	std::vector<uint32_t> stick_elements_{};
+	std::vector<int32_t> analog_bits_{};
+	std::vector<AnalogDirection> analog_directions_{};
+	std::vector<uint8_t> analog_reversed_{};
+	std::vector<uint32_t> analog_elements_{};
 };
 } // namespace slask_spy
 
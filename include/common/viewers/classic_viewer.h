@@ -0,0 +1,41 @@
+#ifndef CLASSIC_VIEWER_H
+#define CLASSIC_VIEWER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "input_mapping.h"
+#include "viewers/protocol_viewer.h"
+
+namespace slask_spy {
+// Wii Classic Controller. The firmware sends the buttons of report bytes 4
+// and 5 active high, followed by the sticks and triggers scaled to full
+// bytes, since the report packs them into 5 and 6 bit fields.
+struct ClassicProtocol {
+	static constexpr ViewerType kType{ViewerType::kClassic};
+	static constexpr std::string_view kName{"classic"};
+	static constexpr std::string_view kDisplayName{"Wii Classic"};
+	static constexpr size_t kDataBytes{65};
+	// Sticks are sent unsigned, centered at 128
+	static constexpr int32_t kAxisCenter{128};
+
+	static constexpr MappingTable kMapping{{
+		Button("right", 0),    Button("down", 1),
+		Button("l", 2),        Button("select", 3),
+		Button("home", 4),     Button("start", 5),
+		Button("r", 6),        Button("zl", 8),
+		Button("b", 9),        Button("y", 10),
+		Button("a", 11),       Button("x", 12),
+		Button("zr", 13),      Button("left", 14),
+		Button("up", 15),
+
+		Axis("lstick_x", 16),  Axis("lstick_y", 24),
+		Axis("rstick_x", 32),  Axis("rstick_y", 40),
+		Axis("trig_l", 48),    Axis("trig_r", 56)}};
+};
+
+using ClassicViewer = ProtocolViewer<ClassicProtocol>;
+} // namespace slask_spy
+
+#endif // CLASSIC_VIEWER_H
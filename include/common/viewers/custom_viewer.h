@@ -0,0 +1,61 @@
+#ifndef CUSTOM_VIEWER_H
+#define CUSTOM_VIEWER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "controller_state.h"
+#include "custom_protocol.h"
+#include "frame_decoder.h"
+#include "viewer.h"
+
+namespace slask_spy {
+// Viewer for a layout loaded at runtime. Frames are packed with the same
+// vector path as the built-in viewers and rearranged by the protocol's
+// gather plan, a handful of operations per frame.
+class CustomViewer final : public Viewer {
+public:
+	explicit CustomViewer(CustomProtocol const &protocol)
+		: Viewer(CustomProtocol::kAxisCenter),
+		  protocol_{protocol}
+	{
+	}
+
+	size_t GetDataBytesSize() const override
+	{
+		return protocol_.DataBytes();
+	}
+
+	char GetDelimiter() const override { return protocol_.Delimiter(); }
+
+	bool SetIncommingData(char const *data, uint64_t arrival_ns) override
+	{
+		ControllerState state{};
+		state.buttons = protocol_.Gather(
+			PackFrameBits(data, protocol_.DataBytes() - 1));
+		return Publish(state, arrival_ns);
+	}
+
+	bool SetIncommingPacked(uint8_t const *payload,
+				uint64_t arrival_ns) override
+	{
+		ControllerState state{};
+		state.buttons = protocol_.Gather(
+			LoadPackedBits(payload, protocol_.DataBytes() - 1));
+		return Publish(state, arrival_ns);
+	}
+
+private:
+	bool Publish(ControllerState &state, uint64_t arrival_ns)
+	{
+		if (protocol_.HasAxes()) {
+			DecodeAxes(&state);
+		}
+		return PublishState(state, arrival_ns);
+	}
+
+	CustomProtocol const protocol_;
+};
+} // namespace slask_spy
+
+#endif // CUSTOM_VIEWER_H
@@ -0,0 +1,31 @@
+#ifndef GBA_VIEWER_H
+#define GBA_VIEWER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "input_mapping.h"
+#include "viewers/protocol_viewer.h"
+
+namespace slask_spy {
+// The ten KEYINPUT bits sent over the link port, active high
+struct GBAProtocol {
+	static constexpr ViewerType kType{ViewerType::kGBA};
+	static constexpr std::string_view kName{"gba"};
+	static constexpr std::string_view kDisplayName{"Game Boy Advance"};
+	static constexpr size_t kDataBytes{11};
+	static constexpr int32_t kAxisCenter{0};
+
+	static constexpr MappingTable kMapping{{
+		Button("a", 0),        Button("b", 1),
+		Button("select", 2),   Button("start", 3),
+		Button("right", 4),    Button("left", 5),
+		Button("up", 6),       Button("down", 7),
+		Button("r", 8),        Button("l", 9)}};
+};
+
+using GBAViewer = ProtocolViewer<GBAProtocol>;
+} // namespace slask_spy
+
+#endif // GBA_VIEWER_H
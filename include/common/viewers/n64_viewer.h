@@ -1,34 +1,35 @@
 #ifndef N64_VIEWER_H
 #define N64_VIEWER_H
 
+#include <cstddef>
 #include <cstdint>
 #include <string_view>
-#include <unordered_map>
 
-#include "viewer.h"
-namespace slask_spy {
-class N64Viewer : public Viewer {
-public:
-	N64Viewer() = default;
-
-	size_t GetDataBytesSize() const override { return kDataBytes; }
+#include "input_mapping.h"
+#include "viewers/protocol_viewer.h"
 
-	static std::unordered_map<std::string_view, int32_t> const &GetMapping()
-	{
-		static std::unordered_map<std::string_view, int32_t> const
-			kMapping{{"a", 0},        {"b", 1},       {"z", 2},
-				 {"start", 3},    {"up", 4},      {"down", 5},
-				 {"left", 6},     {"right", 7},   {"l", 10},
-				 {"r", 11},       {"cup", 12},    {"cdown", 13},
-				 {"cleft", 14},   {"cright", 15},
+namespace slask_spy {
+struct N64Protocol {
+	static constexpr ViewerType kType{ViewerType::kN64};
+	static constexpr std::string_view kName{"n64"};
+	static constexpr std::string_view kDisplayName{"N64"};
+	static constexpr size_t kDataBytes{33};
+	// Sticks are sent as signed bytes
+	static constexpr int32_t kAxisCenter{0};
 
-				 {"stick_x", 16}, {"stick_y", 24}};
-		return kMapping;
-	}
+	static constexpr MappingTable kMapping{{
+		Button("a", 0),        Button("b", 1),
+		Button("z", 2),        Button("start", 3),
+		Button("up", 4),       Button("down", 5),
+		Button("left", 6),     Button("right", 7),
+		Button("l", 10),       Button("r", 11),
+		Button("cup", 12),     Button("cdown", 13),
+		Button("cleft", 14),   Button("cright", 15),
 
-private:
-	static constexpr size_t kDataBytes{33};
+		Axis("stick_x", 16),   Axis("stick_y", 24)}};
 };
+
+using N64Viewer = ProtocolViewer<N64Protocol>;
 } // namespace slask_spy
 
 #endif // N64_VIEWER_H
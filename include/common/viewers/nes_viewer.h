@@ -0,0 +1,30 @@
+#ifndef NES_VIEWER_H
+#define NES_VIEWER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "input_mapping.h"
+#include "viewers/protocol_viewer.h"
+
+namespace slask_spy {
+// The controller's shift register in the order it is clocked out
+struct NESProtocol {
+	static constexpr ViewerType kType{ViewerType::kNES};
+	static constexpr std::string_view kName{"nes"};
+	static constexpr std::string_view kDisplayName{"NES"};
+	static constexpr size_t kDataBytes{9};
+	static constexpr int32_t kAxisCenter{0};
+
+	static constexpr MappingTable kMapping{{
+		Button("a", 0),        Button("b", 1),
+		Button("select", 2),   Button("start", 3),
+		Button("up", 4),       Button("down", 5),
+		Button("left", 6),     Button("right", 7)}};
+};
+
+using NESViewer = ProtocolViewer<NESProtocol>;
+} // namespace slask_spy
+
+#endif // NES_VIEWER_H
@@ -0,0 +1,62 @@
+#ifndef PROTOCOL_VIEWER_H
+#define PROTOCOL_VIEWER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "controller_state.h"
+#include "frame_decoder.h"
+#include "input_mapping.h"
+#include "viewer.h"
+
+namespace slask_spy {
+// Viewer generated from a protocol descriptor, a struct with
+//   static constexpr ViewerType kType;
+//   static constexpr std::string_view kName;         type name in skin.xml
+//   static constexpr std::string_view kDisplayName;
+//   static constexpr size_t kDataBytes;              delimiter included
+//   static constexpr int32_t kAxisCenter;            subtracted from sticks
+//   static constexpr MappingTable kMapping;
+// The frame size is a constant here, so decoding is inlined and unrolled
+// for each console. Register new descriptors in viewer.cpp.
+template<typename Protocol> class ProtocolViewer final : public Viewer {
+public:
+	ProtocolViewer() : Viewer(Protocol::kAxisCenter) {}
+
+	size_t GetDataBytesSize() const override
+	{
+		return Protocol::kDataBytes;
+	}
+
+	static constexpr int32_t GetMappingIndex(std::string_view name)
+	{
+		return Protocol::kMapping.Find(name);
+	}
+
+	bool SetIncommingData(char const *data, uint64_t arrival_ns) override
+	{
+		ControllerState state{};
+		DecodeFixedFrame<kBits, kAxes>(data, &state);
+		return PublishState(state, arrival_ns);
+	}
+
+	bool SetIncommingPacked(uint8_t const *payload,
+				uint64_t arrival_ns) override
+	{
+		ControllerState state{};
+		DecodeFixedPackedFrame<kBits, kAxes>(payload, &state);
+		return PublishState(state, arrival_ns);
+	}
+
+private:
+	static constexpr size_t kBits{Protocol::kDataBytes - 1};
+	static constexpr bool kAxes{Protocol::kMapping.HasAxes()};
+
+	static_assert(Protocol::kDataBytes <= kMaxDataBytes);
+	static_assert(Protocol::kMapping.FitsFrame(Protocol::kDataBytes));
+	static_assert(Protocol::kMapping.NamesUnique());
+};
+} // namespace slask_spy
+
+#endif // PROTOCOL_VIEWER_H
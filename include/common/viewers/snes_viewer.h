@@ -0,0 +1,32 @@
+#ifndef SNES_VIEWER_H
+#define SNES_VIEWER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "input_mapping.h"
+#include "viewers/protocol_viewer.h"
+
+namespace slask_spy {
+// All 16 clocks of the shift register, the last four are always released
+struct SNESProtocol {
+	static constexpr ViewerType kType{ViewerType::kSNES};
+	static constexpr std::string_view kName{"snes"};
+	static constexpr std::string_view kDisplayName{"SNES"};
+	static constexpr size_t kDataBytes{17};
+	static constexpr int32_t kAxisCenter{0};
+
+	static constexpr MappingTable kMapping{{
+		Button("b", 0),        Button("y", 1),
+		Button("select", 2),   Button("start", 3),
+		Button("up", 4),       Button("down", 5),
+		Button("left", 6),     Button("right", 7),
+		Button("a", 8),        Button("x", 9),
+		Button("l", 10),       Button("r", 11)}};
+};
+
+using SNESViewer = ProtocolViewer<SNESProtocol>;
+} // namespace slask_spy
+
+#endif // SNES_VIEWER_H
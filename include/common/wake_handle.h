@@ -0,0 +1,35 @@
+#ifndef WAKE_HANDLE_H
+#define WAKE_HANDLE_H
+
+namespace com_ports {
+// Lets another thread end a blocking wait early. Handle is included in the
+// wait set and becomes signaled on Signal until Clear. An eventfd on Linux,
+// a self-pipe on other POSIX systems and a manual reset event on Windows.
+class WakeHandle {
+public:
+	WakeHandle();
+	~WakeHandle();
+
+	WakeHandle(WakeHandle const &) = delete;
+	WakeHandle &operator=(WakeHandle const &) = delete;
+
+	void Signal();
+	void Clear();
+
+#ifdef _WIN32
+	void *Handle() const { return event_; }
+#else
+	int Handle() const { return read_fd_; }
+#endif
+
+private:
+#ifdef _WIN32
+	void *event_;
+#else
+	int read_fd_;
+	int write_fd_;
+#endif
+};
+} // namespace com_ports
+
+#endif // WAKE_HANDLE_H
@@ -0,0 +1,95 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace slask_spy {
+// A small work-stealing pool for short, independent jobs such as reading
+// skins. Every worker owns a deque, tasks submitted from a worker go to
+// the back of its own deque and are taken back newest first, so a tree
+// walk stays depth first on each thread. Idle workers steal the oldest
+// task of another deque, which is the one closest to the root and holds
+// the most work. Tasks submitted from other threads go to a shared inbox.
+//
+// Tasks are waited for through a WorkGroup, whose Wait runs queued tasks
+// on the calling thread. Without workers, before Start or after Stop,
+// everything then runs on the waiting thread.
+class WorkPool {
+public:
+	static WorkPool &Instance();
+
+	WorkPool(WorkPool const &) = delete;
+	WorkPool &operator=(WorkPool const &) = delete;
+
+	// One worker per core beside the calling thread, up to kMaxWorkers
+	void Start();
+	// Call before the module unloads, joining from a static destructor
+	// is not safe everywhere. The workers finish what is queued first.
+	void Stop();
+
+	void Submit(std::function<void()> task);
+	// Runs one queued task on the calling thread, false when there was
+	// none
+	bool RunOne();
+
+private:
+	static constexpr size_t kMaxWorkers{8};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	WorkPool();
+	~WorkPool();
+
+	void Run(size_t worker);
+	// From the back of queue own and the front of every other queue,
+	// own is the inbox for threads outside the pool
+	bool Take(size_t own, std::function<void()> *task);
+
+	// One per worker followed by the inbox, fixed while workers run
+	std::vector<Queue *> queues_;
+	std::vector<std::thread *> threads_;
+	std::atomic<size_t> queued_;
+	std::atomic<bool> running_;
+	// Only held to sleep and to wake sleepers
+	std::mutex mutex_;
+	std::condition_variable wake_;
+};
+
+// Tracks a set of tasks submitted to a WorkPool, tasks may submit more to
+// the same group while it is being waited for
+class WorkGroup {
+public:
+	explicit WorkGroup(WorkPool &pool);
+	~WorkGroup();
+
+	WorkGroup(WorkGroup const &) = delete;
+	WorkGroup &operator=(WorkGroup const &) = delete;
+
+	// Exceptions thrown by task are logged, the task is finished then
+	void Submit(std::function<void()> task);
+	// Returns once every task submitted so far and every task they
+	// submitted has finished, helping with queued tasks meanwhile
+	void Wait();
+	// Whether every task submitted so far has finished, never runs any.
+	// Once true, what the tasks wrote is visible to the caller.
+	bool Done() const;
+
+private:
+	WorkPool &pool_;
+	mutable std::mutex mutex_;
+	std::condition_variable done_;
+	size_t pending_;
+};
+} // namespace slask_spy
+
+#endif // WORK_POOL_H
@@ -0,0 +1,46 @@
+#ifndef XML_TOKENIZER_H
+#define XML_TOKENIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace slask_spy {
+// One element tag, every view points into the tokenized text
+struct XmlTag {
+	std::string_view name;
+	// Everything between the name and the closing '>' or "/>"
+	std::string_view attributes;
+	// </name>
+	bool closing;
+	// <name .../>
+	bool self_closing;
+
+	// False when the attribute is missing
+	bool Attribute(std::string_view attribute,
+		       std::string_view *value) const;
+	// False when the attribute is missing or not a whole integer
+	bool IntAttribute(std::string_view attribute, int32_t *value) const;
+};
+
+// Splits XML text into tags in a single pass without copying or
+// allocating, text between tags is skipped. Any whitespace and line layout
+// is accepted, declarations and comments are skipped. Entities and CDATA
+// are not supported, which skin and protocol files never need.
+class XmlTokenizer {
+public:
+	explicit XmlTokenizer(std::string_view text) : text_{text}, pos_{0} {}
+
+	// False at the end of the text or when a tag is never closed, the
+	// latter sets Malformed
+	bool Next(XmlTag *tag);
+	bool Malformed() const { return pos_ > text_.size(); }
+
+private:
+	std::string_view const text_;
+	// Past the end once malformed
+	size_t pos_;
+};
+} // namespace slask_spy
+
+#endif // XML_TOKENIZER_H
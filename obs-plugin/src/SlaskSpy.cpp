@@ -2,23 +2,81 @@
 
 #include <obs-module.h>
 #include <plugin-support.h>
+#include <util/platform.h>
 
+#include <algorithm>
 #include <map>
+#include <mutex>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "com_ports.h"
+#include "devices/replay_device.h"
+#include "io_reactor.h"
 #include "logger.h"
+#include "port_catalog.h"
+#include "skin_catalog.h"
 #include "viewer.h"
 
 namespace {
+// Numeric index saved by older versions, only read to migrate to kPort
 constexpr const char *kComPortName{"com_port"};
+// Port id, or the path for ports without one
+constexpr const char *kPort{"port"};
 constexpr const char *kControllerType{"ctrl_type"};
 constexpr const char *kSkinSelect{"skin"};
 constexpr const char *kSkinDirectory{"skin_dir"};
 constexpr const char *kBackgroundSelect{"bg"};
-constexpr uint32_t kBaudRate{115200};
-static std::unordered_map<slask_spy::ViewerType, std::map<std::string, slask_spy::SkinData*>> available_skins;
+constexpr const char *kCapturePath{"capture_path"};
+constexpr const char *kReplayPath{"replay_path"};
+constexpr const char *kReplaySpeed{"replay_speed"};
+constexpr const char *kBaudRate{"baud_rate"};
+constexpr const char *kWireProtocol{"wire_protocol"};
+constexpr int32_t kBaudRates[]{115200, 230400, 500000, 1000000, 2000000};
+// First scene arena block, Reset grows it to fit larger skins
+constexpr size_t kSceneArenaBytes{16 * 1024};
+
+// Shared by every source. The index is kept in the module config
+// directory, which is only known once OBS has loaded the module.
+slask_spy::SkinCatalog &GetSkinCatalog()
+{
+	static slask_spy::SkinCatalog catalog{[]() {
+		std::string path{};
+		char *const directory{obs_module_config_path("")};
+		if (directory != nullptr && os_mkdirs(directory) != -1) {
+			char *const file{
+				obs_module_config_path("skin_index.txt")};
+			path = file;
+			bfree(file);
+		}
+		bfree(directory);
+		return path;
+	}()};
+	return catalog;
+}
+
+std::string PortSetting(com_ports::ComPortData const &port)
+{
+	return port.id.empty() ? port.path : port.id;
+}
+
+// Settings from before port ids only hold the index, which is upgraded to
+// the id of the adapter currently at that index when there is one
+std::string MigratePortSetting(obs_data_t *settings)
+{
+	int32_t const index{
+		static_cast<int32_t>(obs_data_get_int(settings, kComPortName))};
+	auto const ports{com_ports::PortCatalog::Instance().Ports()};
+	for (com_ports::ComPortData const &port : *ports) {
+		if (port.index == index) {
+			std::string const setting{PortSetting(port)};
+			obs_data_set_string(settings, kPort, setting.c_str());
+			return setting;
+		}
+	}
+	return com_ports::PortPath(index);
+}
 }
 
 gs_color_space
@@ -26,8 +84,8 @@ SlaskSpy::GetSpyColorSpace(void *data, size_t count,
 			     const enum gs_color_space *preferred_spaces)
 {
 	SlaskSpy const *spy{static_cast<SlaskSpy *>(data)};
-	if (spy->graphics_ != nullptr) {
-		auto const *bg = spy->graphics_->GetBackground();
+	if (spy->current_->graphics != nullptr) {
+		auto const *bg = spy->current_->graphics->GetBackground();
 		if (bg != nullptr && bg->image3.image2.image.texture != nullptr) {
 			return bg->space;
 		}
@@ -45,11 +103,13 @@ obs_source_info SlaskSpy::GetSourceInfo() {
 		info.get_name = GetSpyName;
 		info.create = CreateSpy;
 		info.destroy = DestroySpy;
+		info.get_defaults = GetSpyDefaults;
 		info.get_width = GetSpyWidth;
 		info.get_height = GetSpyHeight;
 		info.get_properties = GetSpyProperties;
 		info.update = UpdateSpy;
 		info.video_render = RenderSpy;
+		info.video_tick = VideoTickSpy;
 		info.video_get_color_space = GetSpyColorSpace;
 	}
 
@@ -82,11 +142,13 @@ bool SlaskSpy::OnSkinDirectoryChanged(obs_properties_t *properties,
 
 	obs_property_set_enabled(type, true);
 	obs_property_list_clear(type);
-	if (!slask_spy::SkinSettings::FetchSkins(skin_dir, available_skins)) {
+	slask_spy::SkinCatalog::SkinList const available_skins{
+		GetSkinCatalog().Refresh(skin_dir)};
+	if (available_skins->empty()) {
 		return true;
 	}
 	obs_property_list_add_int(type, "None", 0);
-	for (auto const &it : available_skins) {
+	for (auto const &it : *available_skins) {
 		obs_property_list_add_int(
 			type,
 			slask_spy::Viewer::StringFromType(it.first).c_str(),
@@ -108,21 +170,18 @@ bool SlaskSpy::OnControllerTypeChanged(obs_properties_t *properties,
 		return true;
 	}
 
-	if (available_skins.empty()) {
-		std::string const skin_dir{obs_data_get_string(settings, kSkinDirectory)};
-
-		if (skin_dir.empty()) {
-			obs_property_set_enabled(type, false);
-			return true;
-		}
-		if (!slask_spy::SkinSettings::FetchSkins(skin_dir,
-							 available_skins)) {
-			return true;
-		}
+	std::string const skin_dir{
+		obs_data_get_string(settings, kSkinDirectory)};
+	if (skin_dir.empty()) {
+		obs_property_set_enabled(type, false);
+		return true;
 	}
 
-	auto const &skin_data = available_skins.find(kType);
-	if (skin_data == available_skins.end()) {
+	// Held until the list is filled, a refresh elsewhere cannot free it
+	slask_spy::SkinCatalog::SkinList const available_skins{
+		GetSkinCatalog().Get(skin_dir)};
+	auto const &skin_data = available_skins->find(kType);
+	if (skin_data == available_skins->end()) {
 		return true;
 	}
 
@@ -139,24 +198,19 @@ bool SlaskSpy::OnSkinChanged(obs_properties_t *properties, obs_property_t *skin,
 		obs_properties_get(properties, kBackgroundSelect)};
 	obs_property_list_clear(background);
 
-	if (available_skins.empty()) {
-		std::string const skin_dir{
-			obs_data_get_string(settings, kSkinDirectory)};
-
-		if (skin_dir.empty()) {
-			obs_property_set_enabled(obs_properties_get(properties,  kControllerType), false);
-			return true;
-		}
-		if (!slask_spy::SkinSettings::FetchSkins(skin_dir,
-							 available_skins)) {
-			return true;
-		}
+	std::string const skin_dir{
+		obs_data_get_string(settings, kSkinDirectory)};
+	if (skin_dir.empty()) {
+		obs_property_set_enabled(obs_properties_get(properties,  kControllerType), false);
+		return true;
 	}
 
+	slask_spy::SkinCatalog::SkinList const available_skins{
+		GetSkinCatalog().Get(skin_dir)};
 	slask_spy::ViewerType const kType{static_cast<slask_spy::ViewerType>(
 		obs_data_get_int(settings, kControllerType))};
-	auto const &skin_data = available_skins.find(kType);
-	if (skin_data == available_skins.end()) {
+	auto const &skin_data = available_skins->find(kType);
+	if (skin_data == available_skins->end()) {
 		return true;
 	}
 
@@ -179,19 +233,58 @@ obs_properties_t* SlaskSpy::GetSpyProperties(void* data) {
 	
 	obs_property_t *inputs{obs_properties_add_list(
 		properties, 
-		kComPortName, 
+		kPort, 
 		"Select COM device",
 		OBS_COMBO_TYPE_LIST, 
-		OBS_COMBO_FORMAT_INT)};
+		OBS_COMBO_FORMAT_STRING)};
 	
-	auto const ports{com_ports::FetchCOMPorts()};
-	for (int32_t i{0}; i < ports.size(); ++i) {
-		obs_property_list_add_int(
-			inputs, 
-			ports.at(i).friendly_name.c_str(), 
-			static_cast<int64_t>(ports.at(i).index)
-		);
+	// Enumerated in the background, no device is touched here
+	auto const ports{com_ports::PortCatalog::Instance().Ports()};
+	bool selected_listed{false};
+	SlaskSpy const *const spy{static_cast<SlaskSpy *>(data)};
+	for (com_ports::ComPortData const &port : *ports) {
+		std::string const setting{PortSetting(port)};
+		obs_property_list_add_string(inputs, port.friendly_name.c_str(),
+					     setting.c_str());
+		selected_listed |= spy != nullptr && setting == spy->port_;
 	}
+	// Keep an unplugged adapter selectable, the source waits for it
+	if (spy != nullptr && !spy->port_.empty() && !selected_listed) {
+		std::string const name{spy->port_ + " (not connected)"};
+		obs_property_list_add_string(inputs, name.c_str(),
+					     spy->port_.c_str());
+	}
+
+	obs_property_t *baud_rates{obs_properties_add_list(
+		properties, kBaudRate, "Baud rate", OBS_COMBO_TYPE_LIST,
+		OBS_COMBO_FORMAT_INT)};
+	for (int32_t const baud_rate : kBaudRates) {
+		obs_property_list_add_int(baud_rates,
+					  std::to_string(baud_rate).c_str(),
+					  baud_rate);
+	}
+
+	obs_property_t *protocols{obs_properties_add_list(
+		properties, kWireProtocol, "Wire protocol",
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT)};
+	obs_property_list_add_int(
+		protocols, "Packed if the firmware supports it",
+		static_cast<int64_t>(com_ports::WireProtocol::kNegotiate));
+	obs_property_list_add_int(
+		protocols, "Legacy only",
+		static_cast<int64_t>(com_ports::WireProtocol::kLegacy));
+
+	obs_properties_add_path(properties, kCapturePath,
+				"Capture raw frames to file",
+				OBS_PATH_FILE_SAVE, "SlaskSpy capture (*.sspycap)",
+				"");
+	obs_properties_add_path(properties, kReplayPath,
+				"Replay capture instead of COM device",
+				OBS_PATH_FILE, "SlaskSpy capture (*.sspycap)",
+				"");
+	obs_properties_add_float(properties, kReplaySpeed,
+				 "Replay speed (0 = as fast as possible)", 0.0,
+				 100.0, 0.25);
 
 	obs_property_t *skin{obs_properties_add_path(
 		properties, kSkinDirectory, "Skin Directory",
@@ -220,45 +313,129 @@ obs_properties_t* SlaskSpy::GetSpyProperties(void* data) {
 
 	return properties;
 }
-void SlaskSpy::TickSpy() {
-	run_ = true;
-	while (run_) {
-		device_->Tick();
+
+void SlaskSpy::Reset() {
+	std::lock_guard<std::mutex> lock{scene_mutex_};
+	StopDevice();
+	// The source is going away, waiting for decodes is fine here
+	if (pending_ != nullptr) {
+		retired_.push_back(pending_);
+		pending_ = nullptr;
+	}
+	for (Scene *scene : retired_) {
+		ReleaseScene(*scene);
+		delete scene;
 	}
+	retired_.clear();
+	ReleaseScene(*current_);
+	width_ = 1;
+	height_ = 1;
 }
- 
-void SlaskSpy::Reset() {
-	if (tick_thread_ != nullptr) {
-		run_ = false;
-		tick_thread_->join();
-		tick_thread_ = nullptr;
+
+void SlaskSpy::StopDevice()
+{
+	// Stops dispatching into the viewer before anything is deleted
+	if (device_ != nullptr) {
+		com_ports::IOReactor::Instance().Remove(device_);
+		delete device_;
+		device_ = nullptr;
 	}
+}
 
-	if (skin_settings_ != nullptr)
-	{
-		delete skin_settings_;
-		skin_settings_ = nullptr;
+SlaskSpy::Scene &SlaskSpy::PreparePendingScene()
+{
+	// Releasing a scene waits for its decodes, which would hold up the
+	// settings. The graphics thread releases it once they are done.
+	if (pending_ != nullptr) {
+		if (Loading(*pending_)) {
+			retired_.push_back(pending_);
+		} else {
+			RecycleScene(pending_);
+		}
 	}
 
-	if (viewer_ != nullptr) {
-		delete viewer_;
-		viewer_ = nullptr;
+	if (spare_ != nullptr) {
+		pending_ = spare_;
+		spare_ = nullptr;
+	} else {
+		pending_ = new Scene{kSceneArenaBytes};
 	}
+	return *pending_;
+}
 
-	if (device_ != nullptr) {
-		delete device_;
-		device_ = nullptr;
+void SlaskSpy::SwapInPendingScene()
+{
+	Scene &scene{*pending_};
+	// A scene that failed to load swaps in as nothing
+	if (scene.graphics != nullptr) {
+		if (!scene.graphics->ImagesLoaded()) {
+			return;
+		}
+		// Only the texture upload is left for the graphics thread.
+		// A skin whose images did not load swaps in as nothing, the
+		// device goes first as it dispatches into the scene's viewer.
+		if (!scene.graphics->SetupScene(scene.skin_settings,
+						scene.viewer, background_)) {
+			StopDevice();
+			ReleaseScene(scene);
+		}
 	}
 
-	if (graphics_ != nullptr) {
-		delete graphics_;
-		graphics_ = nullptr;
+	Scene *const retired{current_};
+	current_ = &scene;
+	pending_ = nullptr;
+	width_ = scene.graphics != nullptr ? scene.graphics->GetWidth() : 1;
+	height_ = scene.graphics != nullptr ? scene.graphics->GetHeight() : 1;
+	// Its device was stopped when the pending scene was started
+	RecycleScene(retired);
+}
+
+void SlaskSpy::ReleaseRetiredScenes()
+{
+	auto const done{std::partition(
+		retired_.begin(), retired_.end(),
+		[](Scene const *scene) { return Loading(*scene); })};
+	for (auto it{done}; it != retired_.end(); ++it) {
+		RecycleScene(*it);
+	}
+	retired_.erase(done, retired_.end());
+}
+
+void SlaskSpy::RecycleScene(Scene *scene)
+{
+	ReleaseScene(*scene);
+	if (spare_ == nullptr) {
+		spare_ = scene;
+	} else {
+		delete scene;
+	}
+}
+
+bool SlaskSpy::Loading(Scene const &scene)
+{
+	return scene.graphics != nullptr && !scene.graphics->ImagesLoaded();
+}
+
+void SlaskSpy::ReleaseScene(Scene &scene)
+{
+	if (scene.viewer != nullptr) {
+		delete scene.viewer;
+		scene.viewer = nullptr;
 	}
+
+	// Destroys the graphics and the skin settings in one go
+	scene.skin_settings = nullptr;
+	scene.graphics = nullptr;
+	scene.arena.Reset();
 }
 
 void SlaskSpy::UpdateSpy(void* data, obs_data_t* settings) {
 	SlaskSpy *spy{static_cast<SlaskSpy *>(data)};
-	spy->Reset();
+	std::lock_guard<std::mutex> lock{spy->scene_mutex_};
+	// The current scene keeps rendering its last state until the new one
+	// is swapped in, or is replaced by nothing when loading fails
+	spy->StopDevice();
+	Scene &scene{spy->PreparePendingScene()};
 
 	// TODO (Slask): Add selectable background
 	slask_spy::ViewerType const type{static_cast<slask_spy::ViewerType>(
@@ -270,10 +447,11 @@ void SlaskSpy::UpdateSpy(void* data, obs_data_t* settings) {
 
 	spy->skin_path_ = obs_data_get_string(settings, kSkinSelect);
 	spy->skin_path_ += "/";
-	spy->skin_settings_ =
-		slask_spy::SkinSettings::LoadSkinSettings(spy->skin_path_, type);
+	scene.skin_settings =
+		slask_spy::SkinSettings::LoadSkinSettings(spy->skin_path_, type,
+							  scene.arena);
 	
-	if (spy->skin_settings_ == nullptr) {
+	if (scene.skin_settings == nullptr) {
 		Logger::Warn("SlaskSpy: Skin failed to load at path: %s", spy->skin_path_.c_str());
 		return;
 	}
@@ -284,25 +462,114 @@ void SlaskSpy::UpdateSpy(void* data, obs_data_t* settings) {
 		return;
 	}
 
-	spy->com_port_ = static_cast<int32_t>(obs_data_get_int(settings, kComPortName));
-	spy->viewer_ = slask_spy::Viewer::CreateViewer(type);
-	spy->device_ = new com_ports::COMDevice(
-		spy->com_port_, kBaudRate, spy->viewer_->GetDataBytesSize(),
-		[spy](char *data) { spy->viewer_->SetIncommingData(data); },
-		[](){});
+	spy->port_ = obs_data_get_string(settings, kPort);
+	if (spy->port_.empty() &&
+	    obs_data_has_user_value(settings, kComPortName)) {
+		spy->port_ = MigratePortSetting(settings);
+	}
+	scene.viewer =
+		slask_spy::Viewer::CreateViewer(type, scene.skin_settings);
+	if (scene.viewer == nullptr) {
+		return;
+	}
+
+	// Frames arriving before the scene is swapped in wait in the viewer
+	auto const set_data{[viewer = scene.viewer](
+				    com_ports::Frame const &frame) {
+		if (frame.format == com_ports::FrameFormat::kPacked) {
+			return viewer->SetIncommingPacked(
+				reinterpret_cast<uint8_t const *>(frame.data),
+				frame.arrival_ns);
+		}
+		return viewer->SetIncommingData(frame.data, frame.arrival_ns);
+	}};
+	std::string const replay_path{
+		obs_data_get_string(settings, kReplayPath)};
+	if (replay_path.empty()) {
+		int32_t const baud_rate{static_cast<int32_t>(
+			obs_data_get_int(settings, kBaudRate))};
+		com_ports::WireProtocol const protocol{
+			static_cast<com_ports::WireProtocol>(
+				obs_data_get_int(settings, kWireProtocol))};
+		spy->device_ = com_ports::Device::Create(
+			spy->port_, baud_rate, protocol,
+			scene.viewer->GetDataBytesSize(),
+			scene.viewer->GetDelimiter(), set_data, []() {});
+	} else {
+		double const speed{obs_data_get_double(settings, kReplaySpeed)};
+		spy->device_ = new com_ports::ReplayDevice(
+			replay_path, speed, scene.viewer->GetDataBytesSize(),
+			scene.viewer->GetDelimiter(), set_data, []() {});
+	}
+
+	std::string const capture_path{
+		obs_data_get_string(settings, kCapturePath)};
+	if (!capture_path.empty()) {
+		spy->device_->StartCapture(capture_path);
+	}
 			
-	spy->graphics_ = new slask_spy::OBSGraphicsWrapper();
-	spy->graphics_->SetupScene(spy->skin_settings_, spy->viewer_, spy->background_);
-	spy->tick_thread_ =
-		new std::thread([spy]() { spy->TickSpy(); });
+	// Decoded on the WorkPool, VideoTickSpy swaps the scene in once done
+	scene.graphics = scene.arena.Create<slask_spy::OBSGraphicsWrapper>(
+		&scene.arena);
+	scene.graphics->LoadImages(scene.skin_settings, spy->background_);
+	com_ports::IOReactor::Instance().Add(spy->device_);
+}
+
+void SlaskSpy::VideoTickSpy(void *data, float seconds)
+{
+	constexpr float kStatsLogInterval{30.f};
+
+	SlaskSpy *spy{static_cast<SlaskSpy *>(data)};
+	spy->stats_log_timer_ += seconds;
+
+	// Tried again next tick while UpdateSpy holds it
+	std::unique_lock<std::mutex> lock{spy->scene_mutex_, std::try_to_lock};
+	if (!lock.owns_lock()) {
+		return;
+	}
+	if (spy->pending_ != nullptr) {
+		spy->SwapInPendingScene();
+	}
+	if (!spy->retired_.empty()) {
+		spy->ReleaseRetiredScenes();
+	}
+
+	if (spy->stats_log_timer_ < kStatsLogInterval) {
+		return;
+	}
+	spy->stats_log_timer_ = 0.f;
+
+	char const *const name{obs_source_get_name(spy->source_)};
+	if (spy->current_->viewer != nullptr) {
+		spy->latency_reporter_.Log(
+			name, spy->current_->viewer->GetLatencyStats());
+	}
+
+	if (spy->device_ != nullptr) {
+		com_ports::DeviceStats const stats{spy->device_->Stats()};
+		Logger::Info(
+			"com_ports: %s received %llu, dropped %llu, "
+			"corrupt %llu, resyncs %llu, reconnects %llu, "
+			"bytes %llu",
+			name,
+			static_cast<unsigned long long>(stats.frames_received),
+			static_cast<unsigned long long>(stats.frames_dropped),
+			static_cast<unsigned long long>(stats.frames_corrupt),
+			static_cast<unsigned long long>(stats.resyncs),
+			static_cast<unsigned long long>(stats.reconnects),
+			static_cast<unsigned long long>(stats.bytes_read));
+	}
 }
 
 void SlaskSpy::RenderSpy(void* data, gs_effect_t* effect) {
 	SlaskSpy *spy{static_cast<SlaskSpy *>(data)};
-	if (spy->graphics_ == nullptr) {
+	// Same thread as the swap, the current scene cannot change meanwhile
+	slask_spy::OBSGraphicsWrapper *const graphics{
+		spy->current_->graphics};
+	if (graphics == nullptr) {
 		return;
 	}
-	spy->graphics_->Render(effect);
+	graphics->Render(effect);
 }
 
 
@@ -316,6 +583,16 @@ void* SlaskSpy::CreateSpy(obs_data_t* settings, obs_source* source) {
 	return spy;
 }
 
+void SlaskSpy::GetSpyDefaults(obs_data_t *settings)
+{
+	obs_data_set_default_double(settings, kReplaySpeed, 1.0);
+	obs_data_set_default_int(settings, kBaudRate,
+				 com_ports::kDefaultBaudRate);
+	obs_data_set_default_int(
+		settings, kWireProtocol,
+		static_cast<int64_t>(com_ports::WireProtocol::kNegotiate));
+}
+
 void SlaskSpy::DestroySpy(void* data) {
 	SlaskSpy *spy{static_cast<SlaskSpy *>(data)};
 	delete spy;
@@ -323,34 +600,43 @@ void SlaskSpy::DestroySpy(void* data) {
 
 uint32_t SlaskSpy::GetSpyWidth(void* data) {
 	SlaskSpy *spy{static_cast<SlaskSpy *>(data)};
-	if (spy->graphics_ == nullptr) {
-		return 1;
-	}
-	return spy->graphics_->GetWidth();
+	return spy->width_;
 }
 
 uint32_t SlaskSpy::GetSpyHeight(void *data) {
 	SlaskSpy *spy{static_cast<SlaskSpy *>(data)};
-	if (spy->graphics_ == nullptr) {
-		return 1;
-	}
-	return spy->graphics_->GetHeight();
+	return spy->height_;
 }
 
 SlaskSpy::SlaskSpy(obs_source_t *source) : 
 	source_{source}, 
-	com_port_{-1},
+	port_{""},
     skin_path_{""},
-	skin_settings_{nullptr},
-	graphics_{nullptr},
-	viewer_{nullptr},
+	background_{},
+	scene_mutex_{},
+	current_{new Scene{kSceneArenaBytes}},
+	pending_{nullptr},
+	retired_{},
+	spare_{nullptr},
 	device_{nullptr}, 
-	tick_thread_{nullptr},
-	run_{false}
+	width_{1},
+	height_{1},
+	latency_reporter_{},
+	stats_log_timer_{0.f}
 {
 
 }
 
+SlaskSpy::Scene::Scene(size_t arena_bytes)
+	: arena{arena_bytes},
+	  skin_settings{nullptr},
+	  graphics{nullptr},
+	  viewer{nullptr}
+{
+}
+
 SlaskSpy::~SlaskSpy() {
 	Reset();
+	delete current_;
+	delete spare_;
 }
\ No newline at end of file
@@ -4,12 +4,16 @@
 #include <obs-module.h>
 
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <mutex>
 #include <string>
-#include <thread>
+#include <vector>
 
 #include "com_ports.h"
+#include "latency_histogram.h"
 #include "obs_graphics_wrapper.h"
+#include "scene_arena.h"
 #include "skin_settings.h"
 #include "viewer.h"
 
@@ -18,12 +22,14 @@ public:
 	static obs_source_info GetSourceInfo();
 	static const char *GetSpyName(void *type_data);
 	static void* CreateSpy(obs_data_t* settings, obs_source* source);
+	static void GetSpyDefaults(obs_data_t *settings);
 	static void DestroySpy(void *data);
 	static uint32_t GetSpyWidth(void *data);
 	static uint32_t GetSpyHeight(void *data);
 	static obs_properties_t *GetSpyProperties(void *data);
 	static void UpdateSpy(void *data, obs_data_t *settings);
 	static void RenderSpy(void *data, gs_effect_t *effect);
+	static void VideoTickSpy(void *data, float seconds);
 	static gs_color_space GetSpyColorSpace(void *data, size_t count,
 			 const enum gs_color_space *preferred_spaces);
 
@@ -37,24 +43,66 @@ public:
 					    obs_property_t *skin,
 					    obs_data_t *settings);
 
-	void TickSpy();
 	~SlaskSpy();
 
 private:
+	// Everything built from one set of settings. A new scene is loaded
+	// as the pending one while the current one keeps rendering, the
+	// graphics thread swaps it in once its images are decoded.
+	struct Scene {
+		explicit Scene(size_t arena_bytes);
+
+		// Holds the skin settings and graphics of the scene
+		slask_spy::SceneArena arena;
+		slask_spy::SkinSettings *skin_settings;
+		slask_spy::OBSGraphicsWrapper *graphics;
+		slask_spy::Viewer *viewer;
+	};
+
 	SlaskSpy(obs_source_t *source);
 	void Reset();
+	void StopDevice();
+	// Replaces the pending scene with an empty one. A replaced scene
+	// still decoding is retired rather than waited for.
+	Scene &PreparePendingScene();
+	// Graphics thread, with scene_mutex_ held
+	void SwapInPendingScene();
+	// Graphics thread, with scene_mutex_ held. Recycles the retired
+	// scenes that are done decoding.
+	void ReleaseRetiredScenes();
+	// Releases scene and keeps it as the spare or deletes it
+	void RecycleScene(Scene *scene);
+	static void ReleaseScene(Scene &scene);
+	static bool Loading(Scene const &scene);
 	
 	obs_source_t *source_;
 
-	int32_t com_port_;
+	// Port id or path, see com_ports::ResolvePort
+	std::string port_;
 	std::string skin_path_;
 	std::string background_;
-	slask_spy::SkinSettings *skin_settings_;
-	slask_spy::OBSGraphicsWrapper *graphics_;
-	slask_spy::Viewer *viewer_;
-	com_ports::COMDevice *device_;
-	std::thread *tick_thread_;
-	std::atomic<bool> run_;
+	// UpdateSpy builds the pending scene under it, the graphics thread
+	// only tries it so it never waits for a skin to load
+	std::mutex scene_mutex_;
+	// Only changed on the graphics thread, which renders it without the
+	// lock. Empty until the first scene has loaded.
+	Scene *current_;
+	// nullptr when nothing is loading
+	Scene *pending_;
+	// Pending scenes replaced while their images were decoding
+	std::vector<Scene *> retired_;
+	// An empty scene whose arena block is kept for the next load, or
+	// nullptr
+	Scene *spare_;
+	// Delivers into the viewer of the pending scene, or of the current
+	// one once it has been swapped in
+	com_ports::Device *device_;
+	// Of the current scene, read from any thread
+	std::atomic<uint32_t> width_;
+	std::atomic<uint32_t> height_;
+
+	slask_spy::LatencyReporter latency_reporter_;
+	float stats_log_timer_;
 };
 
 #endif // SLASK_SPY_HPP
\ No newline at end of file
@@ -1,33 +1,41 @@
 #include "obs_graphics_wrapper.h"
 
+#include <algorithm>
 #include <graphics/image-file.h>
 #include <graphics/matrix4.h>
 #include <obs-module.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "logger.h"
+#include "texture_cache.h"
 
 namespace slask_spy {
 
-OBSGraphicsWrapper::OBSGraphicsWrapper() : 
-	graphics_{}, 
-	objects_ {},
-	background_identifier_{},
+OBSGraphicsWrapper::OBSGraphicsWrapper(SceneArena *arena) :
+	arena_{arena},
+	graphics_{arena},
+	decode_{WorkPool::Instance()},
+	scene_{},
+	batches_{arena},
+	background_identifier_{arena},
 	  viewer_{nullptr}
 {
 }
 
 OBSGraphicsWrapper::~OBSGraphicsWrapper() {
+	// A scene replaced while loading still has decodes in flight
+	decode_.Wait();
+
 	obs_enter_graphics();
 	for (auto &it : graphics_) {
-		gs_image_file4_free(it.second);
-		delete it.second;
-	}
-	obs_leave_graphics();
-	for (auto &it : objects_) {
-		for (auto &obj : it.second) {
-			delete obj;
+		if (it.second != nullptr) {
+			TextureCache::Instance().Release(it.second);
 		}
 	}
+	obs_leave_graphics();
 }
 
 void OBSGraphicsWrapper::StartDispatchThread(
@@ -36,6 +44,12 @@ void OBSGraphicsWrapper::StartDispatchThread(
 }
 
 void OBSGraphicsWrapper::Render(gs_effect_t* effect) {
+	// Items are only ever updated here, on the graphics thread, from the
+	// latest complete frame published by the reading thread
+	if (viewer_ != nullptr) {
+		viewer_->ApplyLatestState();
+	}
+
 	const bool previous = gs_framebuffer_srgb_enabled();
 	gs_enable_framebuffer_srgb(true);
 	
@@ -50,32 +64,41 @@ void OBSGraphicsWrapper::Render(gs_effect_t* effect) {
 	gs_effect_set_texture_srgb(param, texture);
 	gs_draw_sprite(texture, 0, image->cx, image->cy);
 
-	for (auto const& it : objects_) {
-		gs_image_file *const image =
-			&graphics_.at(it.first)
-				 ->image3.image2.image;
-		gs_texture_t *const texture{image->texture};
+	// One linear pass over the scene, the viewer has already written
+	// every element that changed
+	for (TextureBatch const &batch : batches_) {
+		gs_texture_t *const texture{
+			batch.image->image3.image2.image.texture};
 		gs_effect_set_texture_srgb(param, texture);
-		
-		for (auto const &obj : it.second) {
-			if (obj->IsHidden()) {
+
+		for (uint32_t i{batch.begin}; i < batch.end; ++i) {
+			if (!scene_.Visible(i)) {
 				continue;
 			}
-			GraphicsObject::DrawParams const* draw_region = obj->GetDrawRegion();
+			DrawRegion const &region{scene_.regions[i]};
+			uint32_t const flip{
+				((scene_.flips[i] & SceneState::kFlipX) != 0
+					 ? GS_FLIP_U
+					 : 0U) |
+				((scene_.flips[i] & SceneState::kFlipY) != 0
+					 ? GS_FLIP_V
+					 : 0U)};
+			vec3 translation{};
+			vec3_set(&translation, scene_.translation_x[i],
+				 scene_.translation_y[i], 0.0f);
+			vec3 scaling{};
+			vec3_set(&scaling, scene_.scale_x[i], scene_.scale_y[i],
+				 1.0f);
 
 			gs_matrix_push();
-			gs_matrix_translate(obj->GetTranslation());
-			gs_matrix_scale(obj->GetScaling());
-			gs_draw_sprite_subregion(texture, 
-				obj->GetFlip(), 
-				draw_region->x, 
-				draw_region->y,
-				draw_region->width, 
-				draw_region->height
-			);
+			gs_matrix_translate(&translation);
+			gs_matrix_scale(&scaling);
+			gs_draw_sprite_subregion(texture, flip, region.x,
+						 region.y, region.width,
+						 region.height);
 			gs_matrix_pop();
 		}
-	}	
+	}
 
 	gs_blend_state_pop();
 	gs_enable_framebuffer_srgb(previous);
@@ -93,113 +116,159 @@ void OBSGraphicsWrapper::Update() {
 	
 }
 
+void OBSGraphicsWrapper::LoadImages(SkinSettings const *settings,
+				    std::string const &background)
+{
+	background_identifier_ = background;
+	graphics_.emplace(background_identifier_, nullptr);
+	for (auto const &it : settings->GetAnalogSettings()) {
+		graphics_.emplace(it.image, nullptr);
+	}
+	for (auto const &it : settings->GetStickSettings()) {
+		graphics_.emplace(it.image, nullptr);
+	}
+	for (auto const &it : settings->GetButtonSettings()) {
+		graphics_.emplace(it.image, nullptr);
+	}
+
+	// One task per image, images shared with other sources are only
+	// decoded once by the cache
+	std::string const skin_path{settings->GetSkinPath()};
+	for (auto &it : graphics_) {
+		gs_image_file4_t **const image{&it.second};
+		std::string path{skin_path};
+		path += it.first;
+		decode_.Submit([this, image, path = std::move(path)]() {
+			*image = TextureCache::Instance().Acquire(path);
+		});
+	}
+}
+
+bool OBSGraphicsWrapper::ImagesLoaded() const
+{
+	return decode_.Done();
+}
+
 bool OBSGraphicsWrapper::SetupScene(slask_spy::SkinSettings const *settings,
 				    Viewer *viewer, std::string const& background)
 {
+	if (graphics_.empty()) {
+		LoadImages(settings, background);
+	}
+	// Returns before running any task once ImagesLoaded
+	decode_.Wait();
+
+	// Checked before the scene is built, AddElement scales every element
+	// by the size of its image. A decode task that failed left its image
+	// unset.
+	for (auto const &it : graphics_) {
+		gs_image_file const *const image{
+			it.second != nullptr ? &it.second->image3.image2.image
+					     : nullptr};
+		if (image == nullptr || !image->loaded || image->cx == 0 ||
+		    image->cy == 0) {
+			std::string_view const skin_path{
+				settings->GetSkinPath()};
+			Logger::Warn(
+				"obs_graphics_wrapper: Couldn't load texture: "
+				"%.*s, full path: %.*s%.*s",
+				static_cast<int>(it.first.size()),
+				it.first.data(),
+				static_cast<int>(skin_path.size()),
+				skin_path.data(),
+				static_cast<int>(it.first.size()),
+				it.first.data());
+			return false;
+		}
+	}
 	viewer_ = viewer;
-	background_identifier_ = background;
-	graphics_[background] =
-		new gs_image_file4_t();
-	std::string const path{};
-	gs_image_file4_init(
-		graphics_[background],
-			    (std::string(settings->GetSkinPath()) +
-			     background)
-			.c_str(),
-		GS_IMAGE_ALPHA_PREMULTIPLY_SRGB);
 
 	auto const &analogs = settings->GetAnalogSettings();
+	auto const &sticks = settings->GetStickSettings();
+	auto const &buttons = settings->GetButtonSettings();
+
+	// Textures in order of first use, the elements are then added texture
+	// by texture so Render binds each one once
+	std::vector<std::string_view> textures{};
+	auto const add_texture = [&](CommonSetting const &common) {
+		if (std::find(textures.begin(), textures.end(),
+			      common.image) == textures.end()) {
+			textures.push_back(common.image);
+		}
+	};
 	for (auto const &it : analogs) {
-		LoadGraphicsAnalog(&it, settings->GetSkinPath());
+		add_texture(it);
 	}
-
-	auto const &sticks = settings->GetStickSettings();
 	for (auto const &it : sticks) {
-		LoadGraphicsStick(&it,
-				   settings->GetSkinPath());
+		add_texture(it);
 	}
-
-	auto const &buttons = settings->GetButtonSettings();
 	for (auto const &it : buttons) {
-		LoadGraphicsButton(&it, settings->GetSkinPath());
+		add_texture(it);
 	}
 
+	scene_.Allocate(*arena_,
+			analogs.size() + sticks.size() + buttons.size());
+	viewer_->BindScene(&scene_);
+	for (std::string_view const texture : textures) {
+		uint32_t const begin{static_cast<uint32_t>(scene_.Size())};
+		for (auto const &it : analogs) {
+			if (it.image == texture) {
+				bool const left{it.direction ==
+						AnalogDirection::kLeft};
+				bool const up{it.direction ==
+					      AnalogDirection::kUp};
+				uint32_t const element{
+					AddElement(it, left, up, true)};
+				viewer_->BindAnalog(it, element);
+			}
+		}
+		for (auto const &it : sticks) {
+			if (it.image == texture) {
+				uint32_t const element{
+					AddElement(it, false, false, true)};
+				viewer_->BindStick(it, element, 128.f, 128.f);
+			}
+		}
+		for (auto const &it : buttons) {
+			if (it.image == texture) {
+				// Hidden until the first press
+				uint32_t const element{
+					AddElement(it, false, false, false)};
+				viewer_->BindButton(it, element);
+			}
+		}
+		batches_.push_back(TextureBatch{
+			graphics_[texture], begin,
+			static_cast<uint32_t>(scene_.Size())});
+	}
 
-	bool result{true};
 	obs_enter_graphics();
 	for (auto &it : graphics_) {
-		gs_image_file4_init_texture(it.second);
-		// Validate textures
-		if (!it.second->image3.image2.image.loaded) {
-			result = false;
-			Logger::Warn(
-				"obs_graphics_wrapper: Couldn't load texture: %s, full path: %s",
-				it.first.c_str(),
-				(std::string(std::string(settings->GetSkinPath()) +
-					it.first).c_str()));
-			break;
-		}
+		// Only the first source using an image creates its texture
+		TextureCache::Instance().Upload(it.second);
 	}
 	obs_leave_graphics();
 
-
-	return result;
+	return true;
 }
 
-void OBSGraphicsWrapper::LoadGraphicsStick(StickSetting const *settings,
-					   std::string_view skin_path)
+uint32_t OBSGraphicsWrapper::AddElement(CommonSetting const &common,
+					bool flip_x, bool flip_y, bool visible)
 {
-	auto stick = new OBSInputStick(
-		settings, 
-		GetImage(settings, skin_path),
-		128.f,
-		128.f
-	);
-
-	viewer_->AssignStick(stick);
-	objects_[settings->image].push_back(stick);
-}
-
-void OBSGraphicsWrapper::LoadGraphicsButton(ButtonSetting const *settings,
-					    std::string_view skin_path)
-{
-	auto button = new OBSInputButton(
-		settings, GetImage(settings, skin_path));
-	
-	viewer_->AssignButton(button);
-	objects_[settings->image].push_back(button);
-}
-
-void OBSGraphicsWrapper::LoadGraphicsAnalog(AnalogSetting const *settings,
-					    std::string_view skin_path)
-{
-	auto analog =
-		new OBSInputAnalog(settings, GetImage(settings, skin_path));
-
-	viewer_->AssignAnalog(analog);
-	objects_[settings->image].push_back(analog);
-}
-
-gs_image_file4_t const *
-OBSGraphicsWrapper::GetImage(
-					    CommonSetting const *common,
-					    std::string_view skin_path)
-{
-	gs_image_file4_t *image{nullptr};
-
-	if (graphics_.find(common->image) == graphics_.end())
-	{
-		std::string const path{std::string(skin_path) + common->image};
-		image = new gs_image_file4_t();
-		gs_image_file4_init(image, path.c_str(),
-				    GS_IMAGE_ALPHA_PREMULTIPLY_SRGB);
-		graphics_[common->image] = image;
-		objects_[common->image] = std::vector<GraphicsObject*>();
-	} else {
-		image = graphics_[common->image];
-	}
-
-	return image;
+	gs_image_file const &image{
+		graphics_.at(common.image)->image3.image2.image};
+	float const x{
+		static_cast<float>(common.x + (flip_x ? common.width : 0))};
+	float const y{
+		static_cast<float>(common.y + (flip_y ? common.height : 0))};
+	float const scale_x{(flip_x ? -1.0f : 1.0f) *
+			    static_cast<float>(common.width) / image.cx};
+	float const scale_y{(flip_y ? -1.0f : 1.0f) *
+			    static_cast<float>(common.height) / image.cy};
+	uint32_t const flip{(flip_x ? SceneState::kFlipX : 0U) |
+			    (flip_y ? SceneState::kFlipY : 0U)};
+	return scene_.Add(x, y, scale_x, scale_y,
+			  DrawRegion{0, 0, image.cx, image.cy}, flip, visible);
 }
 
 int32_t OBSGraphicsWrapper::GetWidth() const {
@@ -10,18 +10,20 @@
 
 class OBSLogger : public LoggerImpl {
 	
-	void Info(const char* format) const override {
-		obs_log(LOG_INFO, format);
+	// Messages are already formatted and may contain '%'
+	void Info(const char *message) const override
+	{
+		obs_log(LOG_INFO, "%s", message);
 	}
 
-	void Warn(const char *format) const override
+	void Warn(const char *message) const override
 	{
-		obs_log(LOG_WARNING, format);
+		obs_log(LOG_WARNING, "%s", message);
 	}
 
-	void Error(const char *format) const override
+	void Error(const char *message) const override
 	{
-		obs_log(LOG_ERROR, format);
+		obs_log(LOG_ERROR, "%s", message);
 	}
 };
 
@@ -21,7 +21,9 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 
 #include "logger.h"
 #include "obs_logger.h"
+#include "port_catalog.h"
 #include "SlaskSpy.hpp"
+#include "work_pool.h"
 
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE(PLUGIN_NAME, "en-US")
@@ -31,11 +33,16 @@ bool obs_module_load(void)
 	static obs_source_info info{SlaskSpy::GetSourceInfo()};
 	obs_register_source(&info);
 	Logger::CreateContext(new OBSLogger());
+	com_ports::PortCatalog::Instance().Start();
+	slask_spy::WorkPool::Instance().Start();
 	Logger::Info("plugin loaded successfully (version %s)", PLUGIN_VERSION);
 	return true;
 }
 
 void obs_module_unload(void)
 {
+	com_ports::PortCatalog::Instance().Stop();
+	slask_spy::WorkPool::Instance().Stop();
+	Logger::DestroyContext();
 	obs_log(LOG_INFO, "plugin unloaded");
 }
@@ -0,0 +1,109 @@
+#include "texture_cache.h"
+
+#include <graphics/image-file.h>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "logger.h"
+
+namespace slask_spy {
+namespace {
+// Skins reached through different relative paths share their images
+std::string Key(std::string_view path)
+{
+	std::error_code error{};
+	std::filesystem::path const absolute{
+		std::filesystem::absolute(std::filesystem::path(path), error)};
+	if (error) {
+		return std::string(path);
+	}
+	return absolute.lexically_normal().string();
+}
+} // namespace
+
+TextureCache &TextureCache::Instance()
+{
+	static TextureCache cache{};
+	return cache;
+}
+
+TextureCache::TextureCache()
+	: mutex_{},
+	  entries_{},
+	  images_{}
+{
+}
+
+gs_image_file4_t *TextureCache::Acquire(std::string_view path)
+{
+	std::string const key{Key(path)};
+	Entry *entry{nullptr};
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		auto const it{entries_.find(key)};
+		if (it != entries_.end()) {
+			entry = it->second;
+		} else {
+			entry = new Entry{{}, key, std::string(path), 0, {},
+					  false};
+			entries_.emplace(key, entry);
+			images_.emplace(&entry->image, entry);
+		}
+		++entry->references;
+	}
+
+	// Decoded outside the lock, other images are not held up by it
+	std::call_once(entry->decoded, [entry]() {
+		gs_image_file4_init(&entry->image, entry->path.c_str(),
+				    GS_IMAGE_ALPHA_PREMULTIPLY_SRGB);
+	});
+	return &entry->image;
+}
+
+void TextureCache::Upload(gs_image_file4_t *image)
+{
+	Entry *entry{nullptr};
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		auto const it{images_.find(image)};
+		if (it == images_.end()) {
+			Logger::Error(
+				"texture_cache: Upload of unknown image");
+			return;
+		}
+		entry = it->second;
+	}
+
+	if (!entry->uploaded) {
+		gs_image_file4_init_texture(&entry->image);
+		entry->uploaded = true;
+	}
+}
+
+void TextureCache::Release(gs_image_file4_t *image)
+{
+	Entry *entry{nullptr};
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		auto const it{images_.find(image)};
+		if (it == images_.end()) {
+			Logger::Error(
+				"texture_cache: Release of unknown image");
+			return;
+		}
+		if (--it->second->references > 0) {
+			return;
+		}
+
+		entry = it->second;
+		images_.erase(it);
+		entries_.erase(entry->key);
+	}
+
+	gs_image_file4_free(&entry->image);
+	delete entry;
+}
+} // namespace slask_spy
@@ -0,0 +1,56 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <graphics/image-file.h>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace slask_spy {
+
+// Decoded skin images and their textures, shared by every source using
+// them. Images are keyed by absolute path and counted, the first Acquire
+// decodes one and the last Release frees it.
+//
+// Acquire can be called from any thread, sources acquiring the same
+// image wait for a single decode. Upload and Release need the graphics
+// context.
+class TextureCache {
+public:
+	static TextureCache &Instance();
+
+	TextureCache(TextureCache const &) = delete;
+	TextureCache &operator=(TextureCache const &) = delete;
+
+	// Never nullptr, check loaded for an image that could not be read
+	gs_image_file4_t *Acquire(std::string_view path);
+	// Creates the texture of an acquired image unless that was done
+	void Upload(gs_image_file4_t *image);
+	void Release(gs_image_file4_t *image);
+
+private:
+	struct Entry {
+		gs_image_file4_t image;
+		std::string key;
+		// As given to the first Acquire, which decodes from it
+		std::string path;
+		size_t references;
+		std::once_flag decoded;
+		// Only touched in the graphics context
+		bool uploaded;
+	};
+
+	TextureCache();
+	// Sources release everything before the graphics context goes away,
+	// there is nothing left to free here
+	~TextureCache() = default;
+
+	std::mutex mutex_;
+	std::unordered_map<std::string, Entry *> entries_;
+	std::unordered_map<gs_image_file4_t const *, Entry *> images_;
+};
+} // namespace slask_spy
+
+#endif // TEXTURE_CACHE_H
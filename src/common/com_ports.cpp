@@ -1,208 +1,576 @@
 #include "com_ports.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <cstring>
+#include <functional>
 #include <string>
-#include <thread>
 #include <vector>
+
+#ifdef _WIN32
 #include <windows.h>
 
+#include <cfgmgr32.h>
 #include <devguid.h>
 #include <initguid.h>
 #include <setupapi.h>
 
+#include <map>
+
+#include "devices/com_device.h"
+#include "port_catalog.h"
+#else
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+#include <poll.h>
+
+#include "devices/termios_device.h"
+#endif
+
 #include "logger.h"
+#include "timing.h"
 
 namespace com_ports {
+namespace {
+// Upper bound for a single Tick so its caller can check for shutdown
+constexpr uint64_t kMaxTickWait{100'000'000};
+} // namespace
+
+Device *Device::Create(std::string const &port, int32_t baud_rate,
+		       WireProtocol protocol, size_t frame_size, char delimiter,
+		       DataCallback const &set_data_callback,
+		       UpdateCallback const &graphics_update_callback)
+{
+#ifdef _WIN32
+	return new COMDevice(port, baud_rate, protocol, frame_size, delimiter,
+			     set_data_callback, graphics_update_callback);
+#else
+	return new TermiosDevice(port, baud_rate, protocol, frame_size,
+				 delimiter, set_data_callback,
+				 graphics_update_callback);
+#endif
+}
 
-COMDevice::COMDevice(int32_t com_index, int32_t baud_rate,
-		     size_t read_buffer_size,
-		     std::function<void(char *)> const &set_data_callback,
-		     std::function<void()> const &graphics_update_callback)
-	: handle_{nullptr},
-	  com_index_{com_index},
-	  baud_rate_{baud_rate},
-	  kBufferSize{read_buffer_size},
-	  read_buffer_{new char[kBufferSize]},
+Device::Device(size_t frame_size, char delimiter, WireProtocol protocol,
+	       DataCallback const &set_data_callback,
+	       UpdateCallback const &graphics_update_callback)
+	: parser_{frame_size, delimiter},
+	  protocol_{protocol},
+	  capture_{nullptr},
+	  wake_{},
+	  reconnect_{},
 	  set_data_callback_{set_data_callback},
-	  graphics_update_callback_{graphics_update_callback}
+	  graphics_update_callback_{graphics_update_callback},
+	  tick_deadline_ns_{0},
+	  counters_{},
+	  device_arrived_{false},
+	  awaiting_reconnect_{false},
+	  sessions_{0},
+	  expected_sequence_{0},
+	  has_sequence_{false},
+	  capture_frame_(frame_size),
+	  reported_format_{FrameFormat::kLegacy}
+{
+}
+
+Device::~Device()
 {
-	TryReconnecting();
+	if (capture_ != nullptr) {
+		delete capture_;
+	}
 }
 
-bool COMDevice::Valid()
+bool Device::StartCapture(std::string const &path)
 {
-	return handle_ != INVALID_HANDLE_VALUE;
+	if (capture_ != nullptr) {
+		delete capture_;
+	}
+
+	capture_ = FrameCapture::Open(path, parser_.FrameSize());
+	return capture_ != nullptr;
 }
 
-COMDevice::~COMDevice()
+void Device::BeginSession()
 {
-	if (handle_ != INVALID_HANDLE_VALUE) {
-		CloseHandle(handle_);
+	parser_.Clear();
+	reported_format_ = FrameFormat::kLegacy;
+	has_sequence_ = false;
+	if (sessions_++ > 0) {
+		DeviceCounters::Add(counters_.reconnects, 1);
+	}
+	if (protocol_ != WireProtocol::kNegotiate) {
+		return;
 	}
 
-	if (read_buffer_ != nullptr) {
-		delete[] read_buffer_;
+	// Firmware without packed support ignores the handshake and keeps
+	// sending legacy frames, which are still accepted
+	parser_.SetPackedDetection(true);
+	if (!Write(kPackedHandshake, sizeof(kPackedHandshake))) {
+		Logger::Warn("com_ports: Could not send the packed handshake");
 	}
 }
 
-void COMDevice::Tick()
+bool Device::Write(char const *, size_t)
+{
+	return false;
+}
+
+int Device::PollHandle() const
 {
-	try {
-		DWORD bytes_read = 0;
-		if (!ReadFile(handle_, read_buffer_,
-			      static_cast<DWORD>(kBufferSize), &bytes_read,
-			      nullptr)) {
+	return -1;
+}
 
-			DWORD const error_code{GetLastError()};
+void Device::ReadAvailable(bool) {}
 
-			Logger::Error(
-				"com_ports: Error %i, trying to reconnect");
-			if (!TryReconnecting()) {
-				constexpr int32_t kRetyLengthMilli{500};
-				Logger::Error(
-					"com_ports: Failed to reconnect, trying again in %i ms",
-					kRetyLengthMilli);
-				std::this_thread::sleep_for(
-					std::chrono::milliseconds{
-						kRetyLengthMilli});
-				return;
-			}
-		}
+uint64_t Device::Service(uint64_t)
+{
+	return kNoDeadline;
+}
 
-		if (bytes_read < 1) {
-			return;
-		}
-	} catch (std::exception &e) {
-		Logger::Error("com_ports: %s", e.what());
+void Device::Interrupt()
+{
+	wake_.Signal();
+}
+
+void Device::Tick()
+{
+	uint64_t now_ns{slask_spy::MonotonicNanoseconds()};
+	if (now_ns >= tick_deadline_ns_) {
+		tick_deadline_ns_ = Service(now_ns);
+		now_ns = slask_spy::MonotonicNanoseconds();
+	}
+	awaiting_reconnect_.store(reconnect_.Disconnected(),
+				  std::memory_order_relaxed);
+
+	uint64_t wait_ns{tick_deadline_ns_ > now_ns ? tick_deadline_ns_ - now_ns
+						    : 0};
+	if (wait_ns > kMaxTickWait) {
+		wait_ns = kMaxTickWait;
+	}
+	uint64_t const wait_milli{(wait_ns + 999'999) / 1'000'000};
+
+#ifdef _WIN32
+	if (WaitForSingleObject(static_cast<HANDLE>(wake_.Handle()),
+				static_cast<DWORD>(wait_milli)) ==
+	    WAIT_OBJECT_0) {
+		wake_.Clear();
+	}
+#else
+	int const handle{PollHandle()};
+	pollfd poll_fds[2]{{wake_.Handle(), POLLIN, 0}, {handle, POLLIN, 0}};
+	nfds_t const count{handle != -1 ? 2u : 1u};
+	if (poll(poll_fds, count, static_cast<int>(wait_milli)) <= 0) {
 		return;
 	}
 
-	if (read_buffer_[kBufferSize - 1] != 0x0A) {
+	if (poll_fds[0].revents != 0) {
+		wake_.Clear();
 		return;
 	}
 
-	set_data_callback_(read_buffer_);
-	graphics_update_callback_();
+	ReadAvailable((poll_fds[1].revents &
+		       (POLLERR | POLLHUP | POLLNVAL)) != 0);
+	// Closed on error, let Service decide when to reconnect
+	if (PollHandle() != handle) {
+		tick_deadline_ns_ = 0;
+	}
+#endif
+}
+
+DeviceStats Device::Stats() const
+{
+	return counters_.Load();
+}
+
+void Device::OnDeviceArrival()
+{
+	device_arrived_.store(true, std::memory_order_relaxed);
+}
+
+bool Device::AwaitingReconnect() const
+{
+	return awaiting_reconnect_.load(std::memory_order_relaxed);
 }
 
-bool COMDevice::TryReconnecting()
+void Device::ConsumeDeviceArrival(uint64_t now_ns)
 {
-	if (handle_ != INVALID_HANDLE_VALUE) {
-		CloseHandle(handle_);
+	if (device_arrived_.exchange(false, std::memory_order_relaxed)) {
+		reconnect_.DeviceArrived(now_ns);
 	}
+}
 
-	handle_ = CreateFileA(("COM" + std::to_string(com_index_)).c_str(),
-			      GENERIC_READ, 0, 0, OPEN_EXISTING, 0, nullptr);
+void Device::PublishParserCounters()
+{
+	// The parser keeps plain totals, only the copies are shared
+	counters_.resyncs.store(parser_.ResyncCount(),
+				std::memory_order_relaxed);
+	counters_.frames_corrupt.store(parser_.CorruptCount(),
+				       std::memory_order_relaxed);
+	counters_.bytes_read.store(parser_.BytesCommitted(),
+				   std::memory_order_relaxed);
+}
 
-	if (handle_ == INVALID_HANDLE_VALUE) {
-		Logger::Error(
-			"com_ports: Invalid handle value when trying to connect to com port %i",
-			com_index_);
-		return false;
+size_t Device::DispatchFrames()
+{
+	bool changed{false};
+	uint64_t const arrival_ns{slask_spy::MonotonicNanoseconds()};
+	auto const on_frame{[this, &changed, arrival_ns](char *data,
+							  FrameFormat format,
+							  uint8_t sequence) {
+		if (format == FrameFormat::kPacked) {
+			// Gaps are frames the firmware sent that never arrived
+			// intact, the counter wraps so the gap is modulo 256
+			if (has_sequence_ && sequence != expected_sequence_) {
+				DeviceCounters::Add(
+					counters_.frames_dropped,
+					static_cast<uint8_t>(
+						sequence - expected_sequence_));
+			}
+			expected_sequence_ = static_cast<uint8_t>(sequence + 1);
+			has_sequence_ = true;
+		}
+		DeviceCounters::Add(counters_.frames_received, 1);
+
+		if (capture_ != nullptr) {
+			capture_->Append(CaptureFrame(data, format),
+					 arrival_ns);
+		}
+		changed |= set_data_callback_(
+			Frame{data, arrival_ns, format, sequence});
+	}};
+	size_t const frames{parser_.Parse(on_frame)};
+	PublishParserCounters();
+
+	if (parser_.Format() != reported_format_) {
+		reported_format_ = parser_.Format();
+		Logger::Info("com_ports: Firmware switched to packed frames");
 	}
 
-	DCB serial_params{};
-	serial_params.DCBlength = sizeof(serial_params);
-	if (!GetCommState(handle_, &serial_params)) {
-		handle_ = INVALID_HANDLE_VALUE;
-		Logger::Error(
-			"com_ports: Failed getting parameters for com port %i",
-			com_index_);
-		return false;
+	// Idle controllers repeat the same frame, only wake the renderer when
+	// something actually changed
+	if (changed) {
+		graphics_update_callback_();
 	}
-	serial_params.BaudRate = baud_rate_;
-	serial_params.ByteSize = 8;
-	serial_params.StopBits = TWOSTOPBITS;
-	serial_params.Parity = NOPARITY;
+	return frames;
+}
 
-	COMMTIMEOUTS cto{};
-	GetCommTimeouts(handle_, &cto);
-	cto.ReadIntervalTimeout = 10;
-	cto.ReadTotalTimeoutConstant = 10;
-	cto.ReadTotalTimeoutMultiplier = 10;
-	cto.WriteTotalTimeoutConstant = 10;
-	cto.WriteTotalTimeoutMultiplier = 10;
-	SetCommTimeouts(handle_, &cto);
+char const *Device::CaptureFrame(char const *data, FrameFormat format)
+{
+	if (format == FrameFormat::kLegacy) {
+		return data;
+	}
 
-	if (!SetCommState(handle_, &serial_params)) {
-		handle_ = INVALID_HANDLE_VALUE;
-		Logger::Error(
-			"com_ports: Failed setting parameters for com port %i",
-			com_index_);
-		return false;
+	size_t const bits{parser_.PayloadBits()};
+	for (size_t i{0}; i < bits; ++i) {
+		capture_frame_[i] = static_cast<char>(
+			(static_cast<uint8_t>(data[i >> 3]) >> (i & 7)) & 1);
 	}
+	capture_frame_[bits] = parser_.Delimiter();
+	return capture_frame_.data();
+}
 
-	return true;
+#ifdef _WIN32
+std::string PortPath(int32_t com_index)
+{
+	// The device namespace prefix is needed for COM10 and above
+	return "\\\\.\\COM" + std::to_string(com_index);
+}
+
+namespace {
+// "COM5" to 5, -1 for anything that is not a COM port
+int32_t ComIndex(char const *name)
+{
+	if (strncmp(name, "COM", 3) != 0 || name[3] == '\0') {
+		return -1;
+	}
+	int32_t index{0};
+	for (char const *digit{name + 3}; *digit != '\0'; ++digit) {
+		if (*digit < '0' || *digit > '9' || index >= kMaxPort) {
+			return -1;
+		}
+		index = index * 10 + (*digit - '0');
+	}
+	return index < kMaxPort ? index : -1;
 }
 
+struct PortDetails {
+	std::string friendly_name;
+	std::string id;
+};
+
+// Details of every present port by COM index, from one pass over the ports
+// device class
+std::map<int32_t, PortDetails> PortClassDetails()
+{
+	std::map<int32_t, PortDetails> ports{};
+	HDEVINFO const device_info{SetupDiGetClassDevsA(
+		&GUID_DEVCLASS_PORTS, nullptr, nullptr, DIGCF_PRESENT)};
+	if (device_info == INVALID_HANDLE_VALUE) {
+		return ports;
+	}
+
+	SP_DEVINFO_DATA dev_info_data{};
+	dev_info_data.cbSize = sizeof(dev_info_data);
+	for (DWORD i{0}; SetupDiEnumDeviceInfo(device_info, i, &dev_info_data);
+	     ++i) {
+		HKEY const key{SetupDiOpenDevRegKey(device_info, &dev_info_data,
+						    DICS_FLAG_GLOBAL, 0,
+						    DIREG_DEV, KEY_READ)};
+		if (key == INVALID_HANDLE_VALUE) {
+			continue;
+		}
+
+		char port_name[32]{};
+		DWORD size{sizeof(port_name) - 1};
+		DWORD type{0};
+		LSTATUS const status{RegQueryValueExA(
+			key, "PortName", nullptr, &type,
+			reinterpret_cast<BYTE *>(port_name), &size)};
+		RegCloseKey(key);
+		if (status != ERROR_SUCCESS || type != REG_SZ) {
+			continue;
+		}
+
+		int32_t const index{ComIndex(port_name)};
+		if (index == -1) {
+			continue;
+		}
+
+		PortDetails &details{ports[index]};
+		char friendly_name[256]{};
+		if (SetupDiGetDeviceRegistryPropertyA(
+			    device_info, &dev_info_data, SPDRP_FRIENDLYNAME,
+			    nullptr, reinterpret_cast<BYTE *>(friendly_name),
+			    sizeof(friendly_name) - 1, nullptr)) {
+			details.friendly_name = friendly_name;
+		}
+
+		// USB\VID_xxxx&PID_xxxx\<serial> for adapters with a serial
+		// number, which stays the same whatever COM number it gets
+		char instance_id[MAX_DEVICE_ID_LEN]{};
+		if (SetupDiGetDeviceInstanceIdA(device_info, &dev_info_data,
+						instance_id,
+						sizeof(instance_id), nullptr)) {
+			details.id = instance_id;
+		}
+	}
+
+	SetupDiDestroyDeviceInfoList(device_info);
+	return ports;
+}
+} // namespace
+
 std::vector<ComPortData> FetchCOMPorts()
 {
-	char lp_target_path[5000];
 	std::vector<ComPortData> port_list{};
-	int32_t index{0};
 
-	for (int32_t i{0}; i < kMaxPort; ++i) {
-		std::string str{"COM" + std::to_string(i)};
-		DWORD result{
-			QueryDosDeviceA(str.c_str(), lp_target_path, 5000)};
+	// One call lists every DOS device name, virtual ports without a
+	// device node included
+	std::vector<char> targets(16 * 1024);
+	while (QueryDosDeviceA(nullptr, targets.data(),
+			       static_cast<DWORD>(targets.size())) == 0) {
+		if (GetLastError() != ERROR_INSUFFICIENT_BUFFER ||
+		    targets.size() >= 1024 * 1024) {
+			Logger::Error("com_ports: Could not list DOS devices");
+			return port_list;
+		}
+		targets.resize(targets.size() * 2);
+	}
+
+	std::map<int32_t, PortDetails> const details{PortClassDetails()};
+	for (char const *name{targets.data()}; *name != '\0';
+	     name += strlen(name) + 1) {
+		int32_t const index{ComIndex(name)};
+		if (index == -1) {
+			continue;
+		}
 
-		if (result != 0) {
-			ComPortData const new_port{i, GetFriendlyName(index)};
-			port_list.push_back(new_port);
-			++index;
+		// Virtual ports may have no device node
+		auto const found{details.find(index)};
+		if (found == details.end()) {
+			port_list.push_back(
+				ComPortData{index, name, PortPath(index), ""});
+			continue;
 		}
+		std::string const &friendly_name{found->second.friendly_name};
+		port_list.push_back(ComPortData{
+			index, friendly_name.empty() ? name : friendly_name,
+			PortPath(index), found->second.id});
 	}
+
+	std::sort(port_list.begin(), port_list.end(),
+		  [](ComPortData const &a, ComPortData const &b) {
+			  return a.index < b.index;
+		  });
 	return port_list;
 }
 
-std::string GetFriendlyName(int32_t device)
+std::string ResolvePort(std::string const &port)
 {
-	HDEVINFO h_device_info{SetupDiGetClassDevs(&GUID_DEVCLASS_PORTS, 0,
-						   nullptr, DIGCF_PRESENT)};
+	if (port.empty() || port.rfind("\\\\.\\", 0) == 0) {
+		return port;
+	}
 
-	std::string res{""};
-	if (h_device_info == INVALID_HANDLE_VALUE) {
-		return res;
+	// The background enumeration answers without touching SetupDi. An id
+	// it does not know is an unplugged adapter, the refresh its arrival
+	// triggers brings it back. SetupDi is only walked before the first
+	// enumeration has finished.
+	PortCatalog const &catalog{PortCatalog::Instance()};
+	bool const enumerated{catalog.Enumerated()};
+	auto const ports{catalog.Ports()};
+	for (ComPortData const &data : *ports) {
+		if (data.id == port) {
+			return data.path;
+		}
+	}
+	if (enumerated) {
+		return "";
 	}
 
-	SP_DEVINFO_DATA dev_info_data{};
-	dev_info_data.cbSize = sizeof(dev_info_data);
-	SetupDiEnumDeviceInfo(h_device_info, device, &dev_info_data);
+	for (auto const &[index, details] : PortClassDetails()) {
+		if (details.id == port) {
+			return PortPath(index);
+		}
+	}
+	return "";
+}
+#else
+namespace {
+// Index ranges used to keep the numeric port setting on POSIX systems
+constexpr int32_t kACMBase{0};
+constexpr int32_t kUSBBase{kMaxPort};
+// udev links every USB serial adapter here under a name made of its vendor,
+// product and serial number
+constexpr char kByIdDirectory[]{"/dev/serial/by-id/"};
+
+// By-id name of every tty that has one
+std::map<std::string, std::string> ByIdNames()
+{
+	std::map<std::string, std::string> names{};
+	std::error_code error{};
+	std::filesystem::directory_iterator entries{kByIdDirectory, error};
+	if (error) {
+		// Missing whenever no USB adapter is connected
+		return names;
+	}
 
-	DWORD req_size{0};
-	SetupDiGetDeviceRegistryProperty(h_device_info, &dev_info_data,
-					 SPDRP_HARDWAREID, nullptr, nullptr, 0,
-					 &req_size);
+	for (auto const &entry : entries) {
+		std::filesystem::path const target{
+			std::filesystem::read_symlink(entry.path(), error)};
+		if (error) {
+			continue;
+		}
+		names[target.filename().string()] =
+			entry.path().filename().string();
+	}
+	return names;
+}
 
-	auto hardware_id{
-		std::make_unique<BYTE[]>((req_size > 1) ? req_size : 1)};
+std::string FriendlyName(std::string const &name)
+{
+	// The tty's device is a USB interface, or for ttyUSB a usb-serial
+	// port below one. The product string is on the USB device above, the
+	// first directory holding idVendor.
+	std::error_code error{};
+	std::filesystem::path directory{std::filesystem::canonical(
+		"/sys/class/tty/" + name + "/device", error)};
+	if (error) {
+		return name;
+	}
 
-	DWORD reg_data_type{0};
-	if (SetupDiGetDeviceRegistryProperty(
-		    h_device_info, &dev_info_data, SPDRP_HARDWAREID,
-		    &reg_data_type, hardware_id.get(),
-		    sizeof(hardware_id) * req_size, nullptr)) {
-		req_size = 0;
-		SetupDiGetDeviceRegistryProperty(h_device_info, &dev_info_data,
-						 SPDRP_FRIENDLYNAME, nullptr,
-						 nullptr, 0, &req_size);
+	// Two levels up for ttyUSB and one for ttyACM, a few more are allowed
+	// for adapters behind other bridges
+	constexpr int32_t kMaxLevels{4};
+	for (int32_t level{0}; level <= kMaxLevels; ++level) {
+		if (std::filesystem::exists(directory / "idVendor", error)) {
+			std::ifstream product_file{directory / "product"};
+			std::string product{};
+			if (product_file.is_open() &&
+			    std::getline(product_file, product) &&
+			    !product.empty()) {
+				return product + " (" + name + ")";
+			}
+			break;
+		}
+		directory = directory.parent_path();
+	}
+	return name;
+}
+} // namespace
 
-		auto friendly_name{std::make_unique<BYTE[]>(
-			(req_size > 1) ? req_size : 1)};
-		if (!SetupDiGetDeviceRegistryProperty(
-			    h_device_info, &dev_info_data, SPDRP_FRIENDLYNAME,
-			    nullptr, friendly_name.get(),
-			    sizeof(friendly_name) * req_size, nullptr)) {
-			// device does not have this property set
+std::string PortPath(int32_t com_index)
+{
+	if (com_index >= kUSBBase) {
+		return "/dev/ttyUSB" + std::to_string(com_index - kUSBBase);
+	}
+	return "/dev/ttyACM" + std::to_string(com_index - kACMBase);
+}
 
-			memset(friendly_name.get(), 0,
-			       req_size > 1 ? req_size : 1);
+std::vector<ComPortData> FetchCOMPorts()
+{
+	std::vector<ComPortData> port_list{};
+
+	// sysfs lists every tty the kernel knows about without opening any
+	// of them
+	std::error_code error{};
+	std::filesystem::directory_iterator entries{"/sys/class/tty", error};
+	if (error) {
+		Logger::Error("com_ports: Could not list /sys/class/tty");
+		return port_list;
+	}
+
+	std::map<std::string, std::string> const ids{ByIdNames()};
+	for (auto const &entry : entries) {
+		std::string const name{entry.path().filename().string()};
+		int32_t base{0};
+		if (name.compare(0, 6, "ttyACM") == 0) {
+			base = kACMBase;
+		} else if (name.compare(0, 6, "ttyUSB") == 0) {
+			base = kUSBBase;
+		} else {
+			continue;
 		}
 
-		for (size_t i{0}; i < req_size; i += 2) {
-			res += static_cast<char>(friendly_name[i]);
+		int32_t number{0};
+		char const *const first{name.c_str() + 6};
+		char const *const last{name.c_str() + name.size()};
+		auto const [end, parse_error]{
+			std::from_chars(first, last, number)};
+		if (parse_error != std::errc{} || end != last || number < 0 ||
+		    number >= kMaxPort) {
+			continue;
 		}
+
+		auto const id{ids.find(name)};
+		port_list.push_back(ComPortData{
+			base + number, FriendlyName(name), "/dev/" + name,
+			id != ids.end() ? id->second : std::string{}});
+	}
+
+	std::sort(port_list.begin(), port_list.end(),
+		  [](ComPortData const &a, ComPortData const &b) {
+			  return a.index < b.index;
+		  });
+	return port_list;
+}
+
+std::string ResolvePort(std::string const &port)
+{
+	if (port.empty() || port[0] == '/') {
+		return port;
+	}
+
+	// The link follows the adapter to whatever tty it was given
+	std::string const path{kByIdDirectory + port};
+	std::error_code error{};
+	if (!std::filesystem::exists(path, error)) {
+		return "";
 	}
-	return res;
+	return path;
 }
+#endif
 } // namespace com_ports
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include "custom_protocol.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "frame_parser.h"
+#include "logger.h"
+#include "mapped_file.h"
+#include "xml_tokenizer.h"
+
+namespace slask_spy {
+namespace {
+struct InputLayout {
+	std::string name;
+	int32_t bit;
+	int32_t bits;
+	bool is_signed;
+	bool axis;
+};
+} // namespace
+
+CustomProtocol::CustomProtocol(std::pmr::memory_resource *resource)
+	: data_bytes_{0},
+	  delimiter_{'\n'},
+	  has_axes_{false},
+	  indices_{resource},
+	  source_mask_{0},
+	  target_mask_{0},
+	  flip_mask_{0},
+	  runs_{},
+	  run_count_{0}
+{
+}
+
+int32_t CustomProtocol::Find(std::string_view name) const
+{
+	auto const it{indices_.find(name)};
+	if (it == indices_.end()) {
+		return -1;
+	}
+	return it->second;
+}
+
+CustomProtocol *CustomProtocol::Load(std::string const &path,
+				     std::pmr::memory_resource *resource)
+{
+	MappedFile file{};
+	if (!file.Open(path)) {
+		Logger::Error("custom_protocol: Could not open %s",
+			      path.c_str());
+		return nullptr;
+	}
+
+	int32_t frame_bytes{0};
+	int32_t delimiter{'\n'};
+	bool has_protocol{false};
+	std::vector<InputLayout> inputs{};
+
+	XmlTokenizer tokenizer{file.Contents()};
+	XmlTag tag{};
+	while (tokenizer.Next(&tag)) {
+		if (tag.closing) {
+			continue;
+		}
+
+		std::string_view name{};
+		std::string_view value{};
+		if (tag.name == "protocol") {
+			has_protocol = tag.IntAttribute("frame_bytes",
+							&frame_bytes);
+			if (tag.Attribute("delimiter", &value) &&
+			    !tag.IntAttribute("delimiter", &delimiter)) {
+				has_protocol = false;
+			}
+		} else if (tag.name == "button") {
+			InputLayout input{"", -1, 1, false, false};
+			if (!tag.Attribute("name", &name) ||
+			    !tag.IntAttribute("bit", &input.bit)) {
+				Logger::Error("custom_protocol: %s: button "
+					      "needs a name and a bit",
+					      path.c_str());
+				return nullptr;
+			}
+			input.name = name;
+			inputs.push_back(input);
+		} else if (tag.name == "axis") {
+			InputLayout input{"", -1, 8, false, true};
+			if (!tag.Attribute("name", &name) ||
+			    !tag.IntAttribute("bit", &input.bit)) {
+				Logger::Error("custom_protocol: %s: axis "
+					      "needs a name and a bit",
+					      path.c_str());
+				return nullptr;
+			}
+			if (tag.Attribute("bits", &value) &&
+			    !tag.IntAttribute("bits", &input.bits)) {
+				input.bits = 0;
+			}
+			input.is_signed = tag.Attribute("signed", &value) &&
+					  value == "true";
+			input.name = name;
+			inputs.push_back(input);
+		}
+	}
+	if (tokenizer.Malformed()) {
+		Logger::Error("custom_protocol: %s: a tag is never closed",
+			      path.c_str());
+		return nullptr;
+	}
+
+	// The delimiter may never look like a bit or a packed frame
+	size_t const payload_bits{static_cast<size_t>(frame_bytes) - 1};
+	if (!has_protocol || frame_bytes < 2 ||
+	    static_cast<size_t>(frame_bytes) > kMaxDataBytes ||
+	    delimiter < 2 || delimiter > 255 || delimiter == '1' ||
+	    delimiter == com_ports::kPackedSync) {
+		Logger::Error("custom_protocol: %s: needs a <protocol> with "
+			      "frame_bytes between 2 and %zu and a delimiter "
+			      "that is no bit value",
+			      path.c_str(), kMaxDataBytes);
+		return nullptr;
+	}
+
+	std::sort(inputs.begin(), inputs.end(),
+		  [](InputLayout const &a, InputLayout const &b) {
+			  return a.bit < b.bit;
+		  });
+
+	void *const memory{resource->allocate(sizeof(CustomProtocol),
+					      alignof(CustomProtocol))};
+	CustomProtocol *protocol{new (memory) CustomProtocol(resource)};
+	protocol->data_bytes_ = static_cast<size_t>(frame_bytes);
+	protocol->delimiter_ = static_cast<char>(delimiter);
+
+	int32_t next_source{0};
+	uint32_t next_target{0};
+	// Length of the last run
+	uint32_t run_bits{0};
+	for (InputLayout const &input : inputs) {
+		char const *error{nullptr};
+		if (input.bits < 1 || input.bits > 8) {
+			error = "axes are one to eight bits";
+		} else if (input.bit < next_source) {
+			error = "overlaps the previous input";
+		} else if (static_cast<size_t>(input.bit + input.bits) >
+			   payload_bits) {
+			error = "does not fit the frame";
+		} else if (protocol->indices_.count(
+				   std::string_view(input.name)) != 0) {
+			error = "is defined twice";
+		}
+
+		// Axes take a whole byte, aligned for ControllerState::Axis
+		uint32_t const target{input.axis ? (next_target + 7) & ~7U
+						 : next_target};
+		uint32_t const width{input.axis ? 8U : 1U};
+		if (error == nullptr && target + width > kMaxInputBits) {
+			error = "does not fit, too many inputs";
+		}
+
+		if (error != nullptr) {
+			Logger::Error("custom_protocol: %s: %s %s",
+				      path.c_str(), input.name.c_str(), error);
+			protocol->~CustomProtocol();
+			resource->deallocate(protocol, sizeof(CustomProtocol),
+					     alignof(CustomProtocol));
+			return nullptr;
+		}
+
+		// Narrow axes land in the high bits of their byte, scaling
+		// them to eight bits
+		uint32_t const source{static_cast<uint32_t>(input.bit)};
+		uint32_t const bits{static_cast<uint32_t>(input.bits)};
+		uint64_t const mask{(1ULL << bits) - 1};
+		protocol->source_mask_ |= mask << source;
+		protocol->target_mask_ |= mask << target;
+		if (input.is_signed) {
+			protocol->flip_mask_ |= 1ULL << target;
+		}
+		protocol->has_axes_ |= input.axis;
+		protocol->indices_.emplace(input.name,
+					   static_cast<int32_t>(target));
+
+		size_t const runs{protocol->run_count_};
+		Run *const last{runs > 0 ? &protocol->runs_[runs - 1]
+					 : nullptr};
+		if (last != nullptr && last->source + run_bits == source &&
+		    last->target + run_bits == target) {
+			run_bits += bits;
+			last->mask = run_bits < 64 ? (1ULL << run_bits) - 1
+						   : ~0ULL;
+		} else {
+			protocol->runs_[protocol->run_count_++] =
+				Run{mask, source, target};
+			run_bits = bits;
+		}
+
+		next_source = input.bit + input.bits;
+		next_target = target + width;
+	}
+
+	Logger::Info("custom_protocol: Loaded %s, %zu inputs in %zu runs",
+		     path.c_str(), inputs.size(), protocol->run_count_);
+	return protocol;
+}
+} // namespace slask_spy
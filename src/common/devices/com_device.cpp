@@ -0,0 +1,223 @@
+#include "devices/com_device.h"
+
+#include <cstdint>
+#include <string>
+#include <windows.h>
+
+#include "logger.h"
+#include "timing.h"
+
+namespace com_ports {
+
+COMDevice::COMDevice(std::string const &port, int32_t baud_rate,
+		     WireProtocol protocol, size_t frame_size, char delimiter,
+		     DataCallback const &set_data_callback,
+		     UpdateCallback const &graphics_update_callback)
+	: Device(frame_size, delimiter, protocol, set_data_callback,
+		 graphics_update_callback),
+	  handle_{INVALID_HANDLE_VALUE},
+	  read_event_{CreateEventA(nullptr, TRUE, FALSE, nullptr)},
+	  port_{port},
+	  baud_rate_{baud_rate}
+{
+	if (!TryReconnecting()) {
+		uint64_t const now_ns{slask_spy::MonotonicNanoseconds()};
+		reconnect_.Lost(now_ns);
+		reconnect_.AttemptFailed(now_ns);
+	}
+}
+
+bool COMDevice::Valid() const
+{
+	return handle_ != INVALID_HANDLE_VALUE;
+}
+
+COMDevice::~COMDevice()
+{
+	if (handle_ != INVALID_HANDLE_VALUE) {
+		CloseHandle(handle_);
+	}
+	if (read_event_ != nullptr) {
+		CloseHandle(read_event_);
+	}
+}
+
+void COMDevice::Tick()
+{
+	HANDLE const wake_event{static_cast<HANDLE>(wake_.Handle())};
+
+	if (handle_ == INVALID_HANDLE_VALUE) {
+		TickDisconnected();
+		return;
+	}
+
+	OVERLAPPED overlapped{};
+	overlapped.hEvent = read_event_;
+	char *const write_begin{parser_.WriteBegin()};
+	if (!ReadFile(handle_, write_begin,
+		      static_cast<DWORD>(parser_.WriteCapacity()), nullptr,
+		      &overlapped)) {
+		DWORD const error_code{GetLastError()};
+		if (error_code != ERROR_IO_PENDING) {
+			OnReadError(error_code);
+			return;
+		}
+
+		HANDLE const handles[2]{read_event_, wake_event};
+		if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) ==
+		    WAIT_OBJECT_0 + 1) {
+			wake_.Clear();
+			CancelIoEx(handle_, &overlapped);
+		}
+	}
+
+	// Waits for the read, or its cancellation, to let go of the ring
+	DWORD bytes_read{0};
+	if (!GetOverlappedResult(handle_, &overlapped, &bytes_read, TRUE)) {
+		DWORD const error_code{GetLastError()};
+		if (error_code != ERROR_OPERATION_ABORTED) {
+			OnReadError(error_code);
+		}
+		return;
+	}
+
+	if (bytes_read < 1) {
+		return;
+	}
+	parser_.Commit(bytes_read);
+	DispatchFrames();
+}
+
+void COMDevice::TickDisconnected()
+{
+	uint64_t const now_ns{slask_spy::MonotonicNanoseconds()};
+	ConsumeDeviceArrival(now_ns);
+	if (reconnect_.Due(now_ns)) {
+		if (TryReconnecting()) {
+			Logger::Info(
+				"com_ports: Reconnected to %s on attempt %u",
+				port_.c_str(), reconnect_.Attempts() + 1);
+			reconnect_.Restored();
+			return;
+		}
+		reconnect_.AttemptFailed(now_ns);
+	}
+
+	// Device arrivals interrupt the wait through the wake handle
+	uint64_t const wait_ns{reconnect_.NextAttemptNs() - now_ns};
+	DWORD const wait_milli{
+		static_cast<DWORD>((wait_ns + 999'999) / 1'000'000)};
+	if (WaitForSingleObject(static_cast<HANDLE>(wake_.Handle()),
+				wait_milli) == WAIT_OBJECT_0) {
+		wake_.Clear();
+	}
+}
+
+void COMDevice::OnReadError(DWORD error_code)
+{
+	Logger::Error("com_ports: Lost %s (error %i), reconnecting in the "
+		      "background",
+		      port_.c_str(), error_code);
+	parser_.Clear();
+	CloseHandle(handle_);
+	handle_ = INVALID_HANDLE_VALUE;
+	reconnect_.Lost(slask_spy::MonotonicNanoseconds());
+}
+
+bool COMDevice::TryReconnecting()
+{
+	if (handle_ != INVALID_HANDLE_VALUE) {
+		CloseHandle(handle_);
+	}
+
+	// Background attempts fail silently until one succeeds
+	bool const quiet{reconnect_.Disconnected()};
+
+	// Only the handshake ever writes
+	DWORD const access{protocol_ == WireProtocol::kLegacy
+				   ? GENERIC_READ
+				   : GENERIC_READ | GENERIC_WRITE};
+	// Identities are looked up again on every attempt, the adapter may
+	// have come back under another COM number
+	std::string const path{ResolvePort(port_)};
+	if (path.empty()) {
+		handle_ = INVALID_HANDLE_VALUE;
+		if (!quiet) {
+			Logger::Error("com_ports: %s is not connected",
+				      port_.c_str());
+		}
+		return false;
+	}
+	handle_ = CreateFileA(path.c_str(), access, 0, 0, OPEN_EXISTING,
+			      FILE_FLAG_OVERLAPPED, nullptr);
+
+	if (handle_ == INVALID_HANDLE_VALUE) {
+		if (!quiet) {
+			Logger::Error(
+				"com_ports: Invalid handle value when trying to connect to com port %s",
+				port_.c_str());
+		}
+		return false;
+	}
+
+	DCB serial_params{};
+	serial_params.DCBlength = sizeof(serial_params);
+	if (!GetCommState(handle_, &serial_params)) {
+		CloseHandle(handle_);
+		handle_ = INVALID_HANDLE_VALUE;
+		if (!quiet) {
+			Logger::Error(
+				"com_ports: Failed getting parameters for com port %s",
+				port_.c_str());
+		}
+		return false;
+	}
+	serial_params.BaudRate = baud_rate_;
+	serial_params.ByteSize = 8;
+	serial_params.StopBits = TWOSTOPBITS;
+	serial_params.Parity = NOPARITY;
+
+	// Return as soon as anything is queued, with everything that is queued,
+	// and only wait for the first byte to arrive. Reads are interruptible
+	// so the wait can be long, it only bounds how often an idle port loops.
+	COMMTIMEOUTS cto{};
+	GetCommTimeouts(handle_, &cto);
+	cto.ReadIntervalTimeout = MAXDWORD;
+	cto.ReadTotalTimeoutConstant = 100;
+	cto.ReadTotalTimeoutMultiplier = MAXDWORD;
+	cto.WriteTotalTimeoutConstant = 10;
+	cto.WriteTotalTimeoutMultiplier = 10;
+	SetCommTimeouts(handle_, &cto);
+
+	if (!SetCommState(handle_, &serial_params)) {
+		CloseHandle(handle_);
+		handle_ = INVALID_HANDLE_VALUE;
+		if (!quiet) {
+			Logger::Error(
+				"com_ports: Failed setting parameters for com port %s",
+				port_.c_str());
+		}
+		return false;
+	}
+
+	BeginSession();
+	return true;
+}
+
+bool COMDevice::Write(char const *data, size_t size)
+{
+	// Only called while connecting, no read is using the event
+	OVERLAPPED overlapped{};
+	overlapped.hEvent = read_event_;
+	if (!WriteFile(handle_, data, static_cast<DWORD>(size), nullptr,
+		       &overlapped) &&
+	    GetLastError() != ERROR_IO_PENDING) {
+		return false;
+	}
+
+	// Bounded by the write timeouts set on connect
+	DWORD written{0};
+	return GetOverlappedResult(handle_, &overlapped, &written, TRUE) &&
+	       written == size;
+}
+} // namespace com_ports
@@ -0,0 +1,157 @@
+#include "devices/replay_device.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "frame_capture.h"
+#include "logger.h"
+
+namespace com_ports {
+
+ReplayDevice::ReplayDevice(
+	std::string const &path, double speed, size_t frame_size,
+	char delimiter, DataCallback const &set_data_callback,
+	UpdateCallback const &graphics_update_callback)
+	: Device(frame_size, delimiter, WireProtocol::kLegacy,
+		 set_data_callback, graphics_update_callback),
+	  file_{nullptr},
+	  path_{path},
+	  speed_{speed},
+	  pending_frame_(frame_size),
+	  pending_timestamp_ns_{0},
+	  has_pending_{false},
+	  first_timestamp_ns_{0},
+	  start_ns_{0}
+{
+	file_ = fopen(path_.c_str(), "rb");
+	if (file_ == nullptr) {
+		Logger::Error("replay_device: Could not open %s", path_.c_str());
+		return;
+	}
+
+	size_t capture_frame_size{0};
+	if (!ReadCaptureHeader(file_, &capture_frame_size)) {
+		Logger::Error("replay_device: %s is not a capture file",
+			      path_.c_str());
+		fclose(file_);
+		file_ = nullptr;
+		return;
+	}
+
+	if (capture_frame_size != frame_size) {
+		Logger::Error(
+			"replay_device: %s holds %i byte frames, expected %i",
+			path_.c_str(), static_cast<int32_t>(capture_frame_size),
+			static_cast<int32_t>(frame_size));
+		fclose(file_);
+		file_ = nullptr;
+		return;
+	}
+
+	// Looping an empty capture would spin without ever producing a frame
+	if (!ReadCaptureRecord(file_, frame_size, pending_frame_.data(),
+			       &pending_timestamp_ns_)) {
+		Logger::Error("replay_device: %s holds no frames",
+			      path_.c_str());
+		fclose(file_);
+		file_ = nullptr;
+		return;
+	}
+
+	Rewind();
+}
+
+ReplayDevice::~ReplayDevice()
+{
+	if (file_ != nullptr) {
+		fclose(file_);
+	}
+}
+
+bool ReplayDevice::Valid() const
+{
+	return file_ != nullptr;
+}
+
+bool ReplayDevice::Rewind()
+{
+	has_pending_ = false;
+	first_timestamp_ns_ = 0;
+	start_ns_ = 0;
+	return fseek(file_, static_cast<long>(kCaptureHeaderSize), SEEK_SET) ==
+	       0;
+}
+
+uint64_t ReplayDevice::Service(uint64_t now_ns)
+{
+	if (file_ == nullptr) {
+		return kNoDeadline;
+	}
+
+	if (speed_ > 0.0) {
+		return ServicePaced(now_ns);
+	}
+	return ServiceUnpaced(now_ns);
+}
+
+uint64_t ReplayDevice::ServiceUnpaced(uint64_t now_ns)
+{
+	size_t const frame_size{parser_.FrameSize()};
+
+	// Fill the whole ring straight from the file, one dispatch per batch
+	char *write_begin{parser_.WriteBegin()};
+	while (parser_.WriteCapacity() >= frame_size) {
+		uint64_t timestamp_ns{0};
+		if (!ReadCaptureRecord(file_, frame_size, write_begin,
+				       &timestamp_ns)) {
+			Rewind();
+			break;
+		}
+		parser_.Commit(frame_size);
+		write_begin += frame_size;
+	}
+
+	DispatchFrames();
+	return now_ns;
+}
+
+uint64_t ReplayDevice::ServicePaced(uint64_t now_ns)
+{
+	size_t const frame_size{parser_.FrameSize()};
+
+	// Hand over every frame that is due, then sleep until the next one
+	while (true) {
+		if (!has_pending_) {
+			if (!ReadCaptureRecord(file_, frame_size,
+					       pending_frame_.data(),
+					       &pending_timestamp_ns_)) {
+				Rewind();
+				return now_ns;
+			}
+			has_pending_ = true;
+
+			if (start_ns_ == 0) {
+				first_timestamp_ns_ = pending_timestamp_ns_;
+				start_ns_ = now_ns;
+			}
+		}
+
+		uint64_t const offset_ns{static_cast<uint64_t>(
+			static_cast<double>(pending_timestamp_ns_ -
+					    first_timestamp_ns_) /
+			speed_)};
+		uint64_t const due_ns{start_ns_ + offset_ns};
+		if (due_ns > now_ns) {
+			return due_ns;
+		}
+
+		memcpy(parser_.WriteBegin(), pending_frame_.data(),
+		       frame_size);
+		parser_.Commit(frame_size);
+		has_pending_ = false;
+		DispatchFrames();
+	}
+}
+} // namespace com_ports
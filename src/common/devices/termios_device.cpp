@@ -0,0 +1,254 @@
+#include "devices/termios_device.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "timing.h"
+
+namespace com_ports {
+namespace {
+bool SpeedFromBaudRate(int32_t baud_rate, speed_t *speed)
+{
+	switch (baud_rate) {
+	case 9600:
+		*speed = B9600;
+		return true;
+	case 19200:
+		*speed = B19200;
+		return true;
+	case 38400:
+		*speed = B38400;
+		return true;
+	case 57600:
+		*speed = B57600;
+		return true;
+	case 115200:
+		*speed = B115200;
+		return true;
+	case 230400:
+		*speed = B230400;
+		return true;
+#ifdef B460800
+	case 460800:
+		*speed = B460800;
+		return true;
+#endif
+#ifdef B500000
+	case 500000:
+		*speed = B500000;
+		return true;
+#endif
+#ifdef B921600
+	case 921600:
+		*speed = B921600;
+		return true;
+#endif
+#ifdef B1000000
+	case 1000000:
+		*speed = B1000000;
+		return true;
+#endif
+#ifdef B2000000
+	case 2000000:
+		*speed = B2000000;
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+} // namespace
+
+TermiosDevice::TermiosDevice(
+	std::string const &port, int32_t baud_rate, WireProtocol protocol,
+	size_t frame_size, char delimiter,
+	DataCallback const &set_data_callback,
+	UpdateCallback const &graphics_update_callback)
+	: Device(frame_size, delimiter, protocol, set_data_callback,
+		 graphics_update_callback),
+	  fd_{-1},
+	  port_{port},
+	  baud_rate_{baud_rate}
+{
+	if (!TryReconnecting()) {
+		uint64_t const now_ns{slask_spy::MonotonicNanoseconds()};
+		reconnect_.Lost(now_ns);
+		reconnect_.AttemptFailed(now_ns);
+	}
+}
+
+TermiosDevice::~TermiosDevice()
+{
+	Close();
+}
+
+bool TermiosDevice::Valid() const
+{
+	return fd_ != -1;
+}
+
+void TermiosDevice::Close()
+{
+	if (fd_ != -1) {
+		close(fd_);
+		fd_ = -1;
+	}
+}
+
+int TermiosDevice::PollHandle() const
+{
+	return fd_;
+}
+
+uint64_t TermiosDevice::Service(uint64_t now_ns)
+{
+	if (fd_ != -1) {
+		return kNoDeadline;
+	}
+
+	ConsumeDeviceArrival(now_ns);
+	if (!reconnect_.Due(now_ns)) {
+		return reconnect_.NextAttemptNs();
+	}
+
+	if (!TryReconnecting()) {
+		reconnect_.AttemptFailed(now_ns);
+		return reconnect_.NextAttemptNs();
+	}
+
+	Logger::Info("com_ports: Reconnected to %s on attempt %u",
+		     port_.c_str(), reconnect_.Attempts() + 1);
+	reconnect_.Restored();
+	return kNoDeadline;
+}
+
+void TermiosDevice::ReadAvailable(bool hangup)
+{
+	if (fd_ == -1) {
+		return;
+	}
+
+	int error_code{0};
+	size_t bytes_read{0};
+
+	// Drain everything queued so several frames cost a single wakeup.
+	// WriteBegin always leaves room for at least one frame.
+	while (true) {
+		char *const write_begin{parser_.WriteBegin()};
+		ssize_t const result{
+			read(fd_, write_begin, parser_.WriteCapacity())};
+		if (result > 0) {
+			parser_.Commit(static_cast<size_t>(result));
+			bytes_read += static_cast<size_t>(result);
+			DispatchFrames();
+			continue;
+		}
+
+		if (result < 0 && errno != EAGAIN && errno != EINTR) {
+			error_code = errno;
+		}
+		break;
+	}
+
+	// Readable without data means the other end has gone away
+	if (error_code == 0 && bytes_read == 0 && hangup) {
+		error_code = EIO;
+	}
+
+	if (error_code != 0) {
+		Logger::Error("com_ports: Lost %s (error %i), reconnecting in "
+			      "the background",
+			      port_.c_str(), error_code);
+		parser_.Clear();
+		Close();
+		reconnect_.Lost(slask_spy::MonotonicNanoseconds());
+	}
+}
+
+bool TermiosDevice::TryReconnecting()
+{
+	Close();
+
+	// Background attempts fail silently until one succeeds
+	bool const quiet{reconnect_.Disconnected()};
+
+	// Only the handshake ever writes
+	int const access{protocol_ == WireProtocol::kLegacy ? O_RDONLY
+							   : O_RDWR};
+	// Identities are looked up again on every attempt, the adapter may
+	// have come back under another name
+	std::string const path{ResolvePort(port_)};
+	if (path.empty()) {
+		if (!quiet) {
+			Logger::Error("com_ports: %s is not connected",
+				      port_.c_str());
+		}
+		return false;
+	}
+	fd_ = open(path.c_str(), access | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd_ == -1) {
+		if (!quiet) {
+			Logger::Error("com_ports: Could not open %s: %s",
+				      port_.c_str(), strerror(errno));
+		}
+		return false;
+	}
+
+	speed_t speed{B115200};
+	if (!SpeedFromBaudRate(baud_rate_, &speed)) {
+		Logger::Warn(
+			"com_ports: Unsupported baud rate %i for %s, using 115200",
+			baud_rate_, port_.c_str());
+	}
+
+	termios options{};
+	if (tcgetattr(fd_, &options) != 0) {
+		if (!quiet) {
+			Logger::Error(
+				"com_ports: Failed getting parameters for %s",
+				port_.c_str());
+		}
+		Close();
+		return false;
+	}
+
+	cfmakeraw(&options);
+	cfsetispeed(&options, speed);
+	cfsetospeed(&options, speed);
+	options.c_cflag |= CLOCAL | CREAD | CSTOPB;
+	options.c_cflag &= ~(PARENB | CSIZE);
+	options.c_cflag |= CS8;
+	// Reads never block, waiting is done in poll
+	options.c_cc[VMIN] = 0;
+	options.c_cc[VTIME] = 0;
+
+	if (tcsetattr(fd_, TCSANOW, &options) != 0) {
+		if (!quiet) {
+			Logger::Error(
+				"com_ports: Failed setting parameters for %s",
+				port_.c_str());
+		}
+		Close();
+		return false;
+	}
+	tcflush(fd_, TCIFLUSH);
+	BeginSession();
+
+	return true;
+}
+
+bool TermiosDevice::Write(char const *data, size_t size)
+{
+	// The output queue is empty right after connecting, a short write
+	// never has to wait
+	ssize_t const result{write(fd_, data, size)};
+	return result == static_cast<ssize_t>(size);
+}
+} // namespace com_ports
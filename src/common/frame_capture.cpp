@@ -0,0 +1,104 @@
+#include "frame_capture.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "logger.h"
+
+namespace com_ports {
+namespace {
+// Large enough that appending a frame practically never costs a syscall
+constexpr size_t kWriteBufferSize{1 << 16};
+
+void WriteLittleEndian(uint8_t *out, uint64_t value, size_t bytes)
+{
+	for (size_t i{0}; i < bytes; ++i) {
+		out[i] = static_cast<uint8_t>(value >> (i * 8));
+	}
+}
+
+uint64_t ReadLittleEndian(uint8_t const *in, size_t bytes)
+{
+	uint64_t value{0};
+	for (size_t i{0}; i < bytes; ++i) {
+		value |= static_cast<uint64_t>(in[i]) << (i * 8);
+	}
+	return value;
+}
+} // namespace
+
+FrameCapture *FrameCapture::Open(std::string const &path, size_t frame_size)
+{
+	FILE *file{fopen(path.c_str(), "wb")};
+	if (file == nullptr) {
+		Logger::Error("frame_capture: Could not open %s for writing",
+			      path.c_str());
+		return nullptr;
+	}
+	setvbuf(file, nullptr, _IOFBF, kWriteBufferSize);
+
+	uint8_t header[kCaptureHeaderSize]{};
+	memcpy(header, kCaptureMagic, sizeof(kCaptureMagic));
+	header[sizeof(kCaptureMagic)] = kCaptureVersion;
+	WriteLittleEndian(header + sizeof(kCaptureMagic) + 1, frame_size, 4);
+
+	if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+		Logger::Error("frame_capture: Could not write header to %s",
+			      path.c_str());
+		fclose(file);
+		return nullptr;
+	}
+
+	return new FrameCapture(file, frame_size);
+}
+
+FrameCapture::FrameCapture(FILE *file, size_t frame_size)
+	: file_{file},
+	  kFrameSize{frame_size}
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+	if (file_ != nullptr) {
+		fclose(file_);
+	}
+}
+
+void FrameCapture::Append(char const *frame, uint64_t timestamp_ns)
+{
+	uint8_t timestamp[sizeof(uint64_t)];
+	WriteLittleEndian(timestamp, timestamp_ns, sizeof(timestamp));
+	fwrite(timestamp, 1, sizeof(timestamp), file_);
+	fwrite(frame, 1, kFrameSize, file_);
+}
+
+bool ReadCaptureHeader(FILE *file, size_t *frame_size)
+{
+	uint8_t header[kCaptureHeaderSize]{};
+	if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+	    memcmp(header, kCaptureMagic, sizeof(kCaptureMagic)) != 0 ||
+	    header[sizeof(kCaptureMagic)] != kCaptureVersion) {
+		return false;
+	}
+
+	*frame_size = static_cast<size_t>(
+		ReadLittleEndian(header + sizeof(kCaptureMagic) + 1, 4));
+	return true;
+}
+
+bool ReadCaptureRecord(FILE *file, size_t frame_size, char *frame,
+		       uint64_t *timestamp_ns)
+{
+	uint8_t timestamp[sizeof(uint64_t)];
+	if (fread(timestamp, 1, sizeof(timestamp), file) != sizeof(timestamp) ||
+	    fread(frame, 1, frame_size, file) != frame_size) {
+		return false;
+	}
+
+	*timestamp_ns = ReadLittleEndian(timestamp, sizeof(timestamp));
+	return true;
+}
+} // namespace com_ports
@@ -0,0 +1,75 @@
+#include "frame_decoder.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SLASK_SPY_DECODE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SLASK_SPY_DECODE_SSE2
+#endif
+
+namespace slask_spy {
+uint64_t PackFrameBits(char const *data, size_t bits)
+{
+	uint64_t packed{0};
+	size_t i{0};
+
+#if defined(SLASK_SPY_DECODE_AVX2)
+	__m256i const zero{_mm256_setzero_si256()};
+	for (; i + 32 <= bits; i += 32) {
+		__m256i const bytes{_mm256_loadu_si256(
+			reinterpret_cast<__m256i const *>(data + i))};
+		uint32_t const zeroes{static_cast<uint32_t>(
+			_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, zero)))};
+		packed |= static_cast<uint64_t>(~zeroes) << i;
+	}
+#endif
+
+#if defined(SLASK_SPY_DECODE_AVX2) || defined(SLASK_SPY_DECODE_SSE2)
+	__m128i const zero_128{_mm_setzero_si128()};
+	for (; i + 16 <= bits; i += 16) {
+		__m128i const bytes{_mm_loadu_si128(
+			reinterpret_cast<__m128i const *>(data + i))};
+		uint32_t const zeroes{static_cast<uint32_t>(
+			_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero_128)))};
+		packed |= static_cast<uint64_t>(~zeroes & 0xFFFFU) << i;
+	}
+#endif
+
+	for (; i < bits; ++i) {
+		packed |= static_cast<uint64_t>(data[i] != 0) << i;
+	}
+	return packed;
+}
+
+void DecodeFrame(char const *data, size_t bits, ControllerState *state)
+{
+	state->buttons = PackFrameBits(data, bits);
+	DecodeAxes(state);
+}
+
+uint64_t LoadPackedBits(uint8_t const *payload, size_t bits)
+{
+	// Byte order independent load, the payload is at most eight bytes
+	uint64_t packed{0};
+	size_t const bytes{(bits + 7) / 8};
+	for (size_t i{0}; i < bytes; ++i) {
+		packed |= static_cast<uint64_t>(payload[i]) << (i * 8);
+	}
+	if (bits < kMaxInputBits) {
+		packed &= (1ULL << bits) - 1;
+	}
+	return packed;
+}
+
+void DecodePackedFrame(uint8_t const *payload, size_t bits,
+		       ControllerState *state)
+{
+	state->buttons = LoadPackedBits(payload, bits);
+	DecodeAxes(state);
+}
+} // namespace slask_spy
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "frame_parser.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace com_ports {
+namespace {
+// Enough room to drain several frames per read without wrapping every time
+constexpr size_t kFramesPerRing{32};
+
+struct Crc8Table {
+	uint8_t values[256];
+};
+
+constexpr Crc8Table MakeCrc8Table()
+{
+	Crc8Table table{};
+	for (uint32_t i{0}; i < 256; ++i) {
+		uint8_t crc{static_cast<uint8_t>(i)};
+		for (int32_t bit{0}; bit < 8; ++bit) {
+			uint32_t const shifted{static_cast<uint32_t>(crc) << 1};
+			crc = static_cast<uint8_t>(
+				(crc & 0x80) ? shifted ^ 0x07 : shifted);
+		}
+		table.values[i] = crc;
+	}
+	return table;
+}
+
+constexpr Crc8Table kCrc8Table{MakeCrc8Table()};
+static_assert(kCrc8Table.values[1] == 0x07);
+} // namespace
+
+uint8_t Crc8(uint8_t const *data, size_t size)
+{
+	uint8_t crc{0};
+	for (size_t i{0}; i < size; ++i) {
+		crc = kCrc8Table.values[crc ^ data[i]];
+	}
+	return crc;
+}
+
+FrameParser::FrameParser(size_t frame_size, char delimiter)
+	: kFrameSize{frame_size},
+	  kPackedSize{(frame_size - 1 + 7) / 8 + kPackedOverhead},
+	  kCapacity{frame_size * kFramesPerRing},
+	  kDelimiter{delimiter},
+	  buffer_{new char[kCapacity]},
+	  read_pos_{0},
+	  write_pos_{0},
+	  discarding_{false},
+	  detect_packed_{false},
+	  format_{FrameFormat::kLegacy},
+	  resyncs_{0},
+	  corrupt_{0},
+	  bytes_{0}
+{
+}
+
+FrameParser::~FrameParser()
+{
+	if (buffer_ != nullptr) {
+		delete[] buffer_;
+	}
+}
+
+char *FrameParser::WriteBegin()
+{
+	if (kCapacity - write_pos_ < kFrameSize) {
+		Compact();
+	}
+	return buffer_ + write_pos_;
+}
+
+size_t FrameParser::WriteCapacity() const
+{
+	return kCapacity - write_pos_;
+}
+
+void FrameParser::Commit(size_t bytes)
+{
+	size_t const committed{bytes < WriteCapacity() ? bytes
+						       : WriteCapacity()};
+	write_pos_ += committed;
+	bytes_ += committed;
+}
+
+void FrameParser::Clear()
+{
+	read_pos_ = 0;
+	write_pos_ = 0;
+	discarding_ = false;
+	format_ = FrameFormat::kLegacy;
+}
+
+bool FrameParser::PackedValid(char const *start) const
+{
+	uint8_t const *const bytes{reinterpret_cast<uint8_t const *>(start)};
+	return Crc8(bytes + 1, kPackedSize - 2) == bytes[kPackedSize - 1];
+}
+
+bool FrameParser::SkipToSync(size_t length)
+{
+	if (length < 2) {
+		return false;
+	}
+
+	char const sync{static_cast<char>(kPackedSync)};
+	char *const found{static_cast<char *>(
+		memchr(buffer_ + read_pos_ + 1, sync, length - 1))};
+	if (found == nullptr) {
+		return false;
+	}
+	read_pos_ = static_cast<size_t>(found - buffer_);
+	return true;
+}
+
+void FrameParser::Compact()
+{
+	// Wrap around, the unparsed tail is always shorter than one frame so
+	// this only moves a few bytes once per kFramesPerRing frames
+	size_t const remaining{write_pos_ - read_pos_};
+	if (remaining > 0 && read_pos_ > 0) {
+		memmove(buffer_, buffer_ + read_pos_, remaining);
+	}
+	read_pos_ = 0;
+	write_pos_ = remaining;
+}
+
+} // namespace com_ports
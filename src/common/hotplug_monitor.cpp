@@ -0,0 +1,138 @@
+#include "hotplug_monitor.h"
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+
+#include <cfgmgr32.h>
+#include <initguid.h>
+#include <ntddser.h>
+#endif
+
+#include "logger.h"
+
+namespace com_ports {
+#ifdef __linux__
+HotplugMonitor::HotplugMonitor(ArrivalCallback const &on_arrival,
+			       bool report_removals)
+	: on_arrival_{on_arrival},
+	  kReportRemovals{report_removals},
+	  inotify_fd_{inotify_init1(IN_NONBLOCK | IN_CLOEXEC)}
+{
+	if (inotify_fd_ == -1) {
+		Logger::Warn("hotplug_monitor: inotify unavailable, "
+			     "reconnects rely on backoff alone");
+		return;
+	}
+
+	// udev creates the node and then fixes its permissions, both are
+	// reported so an attempt that was too early gets another chance
+	uint32_t const mask{IN_CREATE | IN_ATTRIB |
+			    (report_removals ? IN_DELETE : 0u)};
+	if (inotify_add_watch(inotify_fd_, "/dev", mask) == -1) {
+		Logger::Warn("hotplug_monitor: Could not watch /dev");
+		close(inotify_fd_);
+		inotify_fd_ = -1;
+	}
+}
+
+HotplugMonitor::~HotplugMonitor()
+{
+	if (inotify_fd_ != -1) {
+		close(inotify_fd_);
+	}
+}
+
+void HotplugMonitor::Drain()
+{
+	alignas(inotify_event) char buffer[4096];
+	bool tty_arrived{false};
+
+	while (true) {
+		ssize_t const length{read(inotify_fd_, buffer, sizeof(buffer))};
+		if (length <= 0) {
+			break;
+		}
+
+		for (ssize_t offset{0}; offset < length;) {
+			inotify_event const *const event{
+				reinterpret_cast<inotify_event const *>(
+					buffer + offset)};
+			// An overflow may have hidden a tty
+			if ((event->mask & IN_Q_OVERFLOW) ||
+			    (event->len > 0 &&
+			     strncmp(event->name, "tty", 3) == 0)) {
+				tty_arrived = true;
+			}
+			offset += static_cast<ssize_t>(sizeof(inotify_event) +
+						       event->len);
+		}
+	}
+
+	if (tty_arrived) {
+		on_arrival_();
+	}
+}
+#elif defined(_WIN32)
+namespace {
+DWORD CALLBACK OnNotification(HCMNOTIFICATION, PVOID context,
+			      CM_NOTIFY_ACTION action, PCM_NOTIFY_EVENT_DATA,
+			      DWORD)
+{
+	HotplugMonitor const *const monitor{
+		static_cast<HotplugMonitor const *>(context)};
+	if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL ||
+	    (action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL &&
+	     monitor->ReportsRemovals())) {
+		monitor->NotifyArrival();
+	}
+	return ERROR_SUCCESS;
+}
+} // namespace
+
+HotplugMonitor::HotplugMonitor(ArrivalCallback const &on_arrival,
+			       bool report_removals)
+	: on_arrival_{on_arrival},
+	  kReportRemovals{report_removals},
+	  notification_{nullptr}
+{
+	CM_NOTIFY_FILTER filter{};
+	filter.cbSize = sizeof(filter);
+	filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+	filter.u.DeviceInterface.ClassGuid = GUID_DEVINTERFACE_COMPORT;
+
+	HCMNOTIFICATION notification{nullptr};
+	if (CM_Register_Notification(&filter, this, OnNotification,
+				     &notification) != CR_SUCCESS) {
+		Logger::Warn("hotplug_monitor: Could not register for COM "
+			     "port arrivals, reconnects rely on backoff alone");
+		return;
+	}
+	notification_ = notification;
+}
+
+HotplugMonitor::~HotplugMonitor()
+{
+	// Waits for callbacks in progress
+	if (notification_ != nullptr) {
+		CM_Unregister_Notification(
+			static_cast<HCMNOTIFICATION>(notification_));
+	}
+}
+#else
+HotplugMonitor::HotplugMonitor(ArrivalCallback const &on_arrival,
+			       bool report_removals)
+	: on_arrival_{on_arrival},
+	  kReportRemovals{report_removals}
+{
+}
+
+HotplugMonitor::~HotplugMonitor() {}
+#endif
+} // namespace com_ports
@@ -0,0 +1,325 @@
+#include "io_reactor.h"
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+#include "logger.h"
+#include "timing.h"
+
+namespace com_ports {
+#ifdef __linux__
+namespace {
+constexpr int kMaxEvents{32};
+// Entry ids start after the reactor's own descriptors
+constexpr uint64_t kWakeId{0};
+constexpr uint64_t kHotplugId{1};
+} // namespace
+
+IOReactor &IOReactor::Instance()
+{
+	static IOReactor reactor{};
+	return reactor;
+}
+
+IOReactor::IOReactor()
+	: epoll_fd_{epoll_create1(EPOLL_CLOEXEC)},
+	  wake_{},
+	  next_id_{kHotplugId + 1},
+	  running_{false},
+	  entries_{},
+	  thread_{nullptr},
+	  hotplug_{new HotplugMonitor([this]() { NotifyDeviceArrival(); })}
+{
+	if (epoll_fd_ == -1) {
+		Logger::Error("io_reactor: Could not create epoll instance");
+		return;
+	}
+
+	epoll_event event{};
+	event.events = EPOLLIN;
+	event.data.u64 = kWakeId;
+	epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_.Handle(), &event);
+
+	if (hotplug_->Handle() != -1) {
+		event.data.u64 = kHotplugId;
+		epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, hotplug_->Handle(), &event);
+	}
+}
+
+IOReactor::~IOReactor()
+{
+	std::lock_guard<std::mutex> lifecycle_lock{lifecycle_mutex_};
+	if (thread_ != nullptr) {
+		Stop();
+	}
+	delete hotplug_;
+
+	if (epoll_fd_ != -1) {
+		close(epoll_fd_);
+	}
+}
+
+void IOReactor::Add(Device *device)
+{
+	std::lock_guard<std::mutex> lifecycle_lock{lifecycle_mutex_};
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		// Deadline 0 services the device on the next iteration
+		entries_.push_back(Entry{next_id_++, device, -1, 0});
+		UpdateRegistration(entries_.back());
+		running_ = true;
+	}
+
+	if (thread_ == nullptr) {
+		thread_ = new std::thread([this]() { Run(); });
+	} else {
+		wake_.Signal();
+	}
+}
+
+void IOReactor::Remove(Device *device)
+{
+	std::lock_guard<std::mutex> lifecycle_lock{lifecycle_mutex_};
+	bool empty{false};
+	{
+		// Waits for a dispatch in progress on the reactor thread
+		std::lock_guard<std::mutex> lock{mutex_};
+		for (size_t i{0}; i < entries_.size(); ++i) {
+			if (entries_[i].device != device) {
+				continue;
+			}
+
+			if (entries_[i].registered_handle != -1) {
+				epoll_ctl(epoll_fd_, EPOLL_CTL_DEL,
+					  entries_[i].registered_handle,
+					  nullptr);
+			}
+			entries_.erase(entries_.begin() + i);
+			break;
+		}
+		empty = entries_.empty();
+	}
+
+	// No thread is kept around while no source is open
+	if (empty && thread_ != nullptr) {
+		Stop();
+	}
+}
+
+void IOReactor::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		running_ = false;
+	}
+	wake_.Signal();
+	thread_->join();
+	delete thread_;
+	thread_ = nullptr;
+}
+
+void IOReactor::NotifyDeviceArrival()
+{
+	// Called from Drain on the reactor thread, mutex_ is already held
+	for (Entry &entry : entries_) {
+		entry.device->OnDeviceArrival();
+		entry.deadline_ns = 0;
+	}
+}
+
+IOReactor::Entry *IOReactor::Find(uint64_t id)
+{
+	for (Entry &entry : entries_) {
+		if (entry.id == id) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+void IOReactor::UpdateRegistration(Entry &entry)
+{
+	int const handle{entry.device->PollHandle()};
+	if (handle == entry.registered_handle) {
+		return;
+	}
+
+	// A closed handle is already gone from the epoll set, the delete only
+	// matters for handles that are still open
+	if (entry.registered_handle != -1) {
+		epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, entry.registered_handle,
+			  nullptr);
+	}
+
+	if (handle != -1) {
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.u64 = entry.id;
+		if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, handle, &event) != 0) {
+			Logger::Error("io_reactor: Could not watch handle %i",
+				      handle);
+		}
+	}
+	entry.registered_handle = handle;
+
+	// Let the device schedule its reconnect or whatever else follows
+	entry.deadline_ns = 0;
+}
+
+void IOReactor::Run()
+{
+	epoll_event events[kMaxEvents];
+	int timeout_milli{0};
+
+	while (true) {
+		int const count{epoll_wait(epoll_fd_, events, kMaxEvents,
+					   timeout_milli)};
+
+		std::lock_guard<std::mutex> lock{mutex_};
+		if (!running_) {
+			return;
+		}
+
+		for (int i{0}; i < count; ++i) {
+			uint64_t const id{events[i].data.u64};
+			if (id == kWakeId) {
+				wake_.Clear();
+				continue;
+			}
+			if (id == kHotplugId) {
+				hotplug_->Drain();
+				continue;
+			}
+
+			// Removed while we were waiting
+			Entry *const entry{Find(id)};
+			if (entry == nullptr) {
+				continue;
+			}
+
+			uint32_t const flags{events[i].events};
+			bool const hangup{(flags & (EPOLLERR | EPOLLHUP)) != 0};
+			entry->device->ReadAvailable(hangup);
+			UpdateRegistration(*entry);
+		}
+
+		uint64_t const now_ns{slask_spy::MonotonicNanoseconds()};
+		uint64_t next_ns{kNoDeadline};
+		for (Entry &entry : entries_) {
+			if (entry.deadline_ns <= now_ns) {
+				Device *const device{entry.device};
+				entry.deadline_ns = device->Service(now_ns);
+				UpdateRegistration(entry);
+			}
+			if (entry.deadline_ns < next_ns) {
+				next_ns = entry.deadline_ns;
+			}
+		}
+
+		if (next_ns == kNoDeadline) {
+			timeout_milli = -1;
+		} else if (next_ns <= now_ns) {
+			timeout_milli = 0;
+		} else {
+			uint64_t const wait_milli{
+				(next_ns - now_ns + 999'999) / 1'000'000};
+			timeout_milli = wait_milli < INT_MAX
+						? static_cast<int>(wait_milli)
+						: INT_MAX;
+		}
+	}
+}
+#else
+IOReactor &IOReactor::Instance()
+{
+	static IOReactor reactor{};
+	return reactor;
+}
+
+IOReactor::IOReactor()
+	: workers_{},
+	  hotplug_{new HotplugMonitor([this]() { NotifyDeviceArrival(); })}
+{
+}
+
+IOReactor::~IOReactor()
+{
+	// Unregistering waits for arrival callbacks, which take the lock
+	delete hotplug_;
+
+	std::lock_guard<std::mutex> lifecycle_lock{lifecycle_mutex_};
+	Stop();
+}
+
+void IOReactor::NotifyDeviceArrival()
+{
+	// Called from a system thread, the interrupt ends a reconnect wait.
+	// Connected devices are left alone, interrupting one cancels its read
+	// in flight.
+	std::lock_guard<std::mutex> lifecycle_lock{lifecycle_mutex_};
+	for (Worker *worker : workers_) {
+		if (!worker->device->AwaitingReconnect()) {
+			continue;
+		}
+		worker->device->OnDeviceArrival();
+		worker->device->Interrupt();
+	}
+}
+
+void IOReactor::Add(Device *device)
+{
+	std::lock_guard<std::mutex> lifecycle_lock{lifecycle_mutex_};
+	Worker *const worker{new Worker{device, nullptr, {true}}};
+	worker->thread = new std::thread([worker]() {
+		while (worker->running) {
+			worker->device->Tick();
+		}
+	});
+	workers_.push_back(worker);
+}
+
+void IOReactor::Remove(Device *device)
+{
+	std::lock_guard<std::mutex> lifecycle_lock{lifecycle_mutex_};
+	for (size_t i{0}; i < workers_.size(); ++i) {
+		Worker *const worker{workers_[i]};
+		if (worker->device != device) {
+			continue;
+		}
+
+		worker->running = false;
+		worker->device->Interrupt();
+		worker->thread->join();
+		delete worker->thread;
+		delete worker;
+		workers_.erase(workers_.begin() + i);
+		return;
+	}
+}
+
+void IOReactor::Stop()
+{
+	// Interrupt everything first so the joins overlap
+	for (Worker *worker : workers_) {
+		worker->running = false;
+		worker->device->Interrupt();
+	}
+
+	for (Worker *worker : workers_) {
+		worker->thread->join();
+		delete worker->thread;
+		delete worker;
+	}
+	workers_.clear();
+}
+#endif
+} // namespace com_ports
@@ -0,0 +1,132 @@
+#include "latency_histogram.h"
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "logger.h"
+
+namespace slask_spy {
+
+size_t LatencyHistogram::BucketIndex(uint64_t value_ns)
+{
+	constexpr uint64_t kMaxValue{(1ULL << kMaxValueBits) - 1};
+	if (value_ns > kMaxValue) {
+		value_ns = kMaxValue;
+	}
+
+	if (value_ns < 2 * kHalfSubBuckets) {
+		return static_cast<size_t>(value_ns);
+	}
+
+	int32_t const shift{static_cast<int32_t>(std::bit_width(value_ns)) -
+			    kSubBucketBits};
+	return static_cast<size_t>(shift) * kHalfSubBuckets +
+	       static_cast<size_t>(value_ns >> shift);
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(size_t index)
+{
+	if (index < 2 * kHalfSubBuckets) {
+		return index;
+	}
+
+	size_t const shift{index / kHalfSubBuckets - 1};
+	uint64_t const sub_bucket{index - shift * kHalfSubBuckets};
+	return ((sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t value_ns)
+{
+	// Single writer, a plain load and store is enough and never stalls on
+	// a readers cache line the way a locked increment would
+	std::atomic<uint32_t> &count{counts_[BucketIndex(value_ns)]};
+	count.store(count.load(std::memory_order_relaxed) + 1,
+		    std::memory_order_relaxed);
+	total_.store(total_.load(std::memory_order_relaxed) + 1,
+		     std::memory_order_relaxed);
+
+	if (value_ns > max_ns_.load(std::memory_order_relaxed)) {
+		max_ns_.store(value_ns, std::memory_order_relaxed);
+	}
+}
+
+LatencySnapshot LatencyHistogram::Snapshot() const
+{
+	LatencySnapshot snapshot{std::vector<uint32_t>(kBucketCount), 0,
+				 max_ns_.load(std::memory_order_relaxed)};
+	for (size_t i{0}; i < kBucketCount; ++i) {
+		snapshot.counts[i] = counts_[i].load(std::memory_order_relaxed);
+		snapshot.total += snapshot.counts[i];
+	}
+	return snapshot;
+}
+
+uint64_t LatencySnapshot::Percentile(double quantile) const
+{
+	if (total == 0) {
+		return 0;
+	}
+
+	uint64_t const target{static_cast<uint64_t>(
+		std::ceil(quantile * static_cast<double>(total)))};
+	uint64_t seen{0};
+	for (size_t i{0}; i < counts.size(); ++i) {
+		seen += counts[i];
+		if (seen >= target && counts[i] > 0) {
+			uint64_t const bound{
+				LatencyHistogram::BucketUpperBound(i)};
+			return bound < max_ns ? bound : max_ns;
+		}
+	}
+	return max_ns;
+}
+
+LatencySnapshot LatencySnapshot::Since(LatencySnapshot const &previous) const
+{
+	LatencySnapshot interval{counts, 0, 0};
+	for (size_t i{0}; i < interval.counts.size(); ++i) {
+		if (i < previous.counts.size()) {
+			interval.counts[i] -= previous.counts[i];
+		}
+		interval.total += interval.counts[i];
+		if (interval.counts[i] > 0) {
+			interval.max_ns = LatencyHistogram::BucketUpperBound(i);
+		}
+	}
+	if (interval.max_ns > max_ns) {
+		interval.max_ns = max_ns;
+	}
+	return interval;
+}
+
+void LatencyReporter::Log(char const *source_name, LatencyStats const &stats)
+{
+	LatencySnapshot const decode{stats.decode.Snapshot()};
+	LatencySnapshot const render{stats.render.Snapshot()};
+	LatencySnapshot const decode_interval{decode.Since(previous_decode_)};
+	LatencySnapshot const render_interval{render.Since(previous_render_)};
+	previous_decode_ = decode;
+	previous_render_ = render;
+
+	if (decode_interval.total == 0) {
+		return;
+	}
+
+	constexpr double kMicro{1000.0};
+	Logger::Info(
+		"latency: %s frames %llu, decode p50 %.1f p99 %.1f max %.1f us, "
+		"rendered %llu, render p50 %.1f p99 %.1f max %.1f us",
+		source_name,
+		static_cast<unsigned long long>(decode_interval.total),
+		static_cast<double>(decode_interval.Percentile(0.5)) / kMicro,
+		static_cast<double>(decode_interval.Percentile(0.99)) / kMicro,
+		static_cast<double>(decode_interval.max_ns) / kMicro,
+		static_cast<unsigned long long>(render_interval.total),
+		static_cast<double>(render_interval.Percentile(0.5)) / kMicro,
+		static_cast<double>(render_interval.Percentile(0.99)) / kMicro,
+		static_cast<double>(render_interval.max_ns) / kMicro);
+}
+
+} // namespace slask_spy
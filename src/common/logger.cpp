@@ -0,0 +1,251 @@
+#include "logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include "timing.h"
+
+namespace {
+// A missed notify only delays the flush by this much
+constexpr int32_t kFlushIntervalMilli{100};
+constexpr uint32_t kRateCountBits{24};
+constexpr uint64_t kRateCountMask{(1ULL << kRateCountBits) - 1};
+} // namespace
+
+Logger &Logger::Get()
+{
+	static Logger inst{};
+	return inst;
+}
+
+Logger::Logger()
+	: impl_{nullptr},
+	  ring_{new Record[kRingRecords]},
+	  enqueue_pos_{0},
+	  dequeue_pos_{0},
+	  dropped_{0},
+	  rate_{},
+	  thread_{nullptr},
+	  running_{false},
+	  mutex_{},
+	  wake_{}
+{
+	for (size_t i{0}; i < kRingRecords; ++i) {
+		ring_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+Logger::~Logger()
+{
+	Stop();
+	delete impl_.load();
+	delete[] ring_;
+}
+
+void Logger::CreateContext(LoggerImpl *logger_implementation)
+{
+	Logger &logger{Get()};
+	logger.Stop();
+	delete logger.impl_.exchange(logger_implementation);
+
+	logger.running_ = true;
+	logger.thread_ = new std::thread([&logger]() { logger.Run(); });
+}
+
+void Logger::DestroyContext()
+{
+	Logger &logger{Get()};
+	logger.Stop();
+	delete logger.impl_.exchange(nullptr);
+}
+
+void Logger::Stop()
+{
+	if (thread_ == nullptr) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		running_ = false;
+	}
+	wake_.notify_one();
+	thread_->join();
+	delete thread_;
+	thread_ = nullptr;
+}
+
+void Logger::Write(LogLevel level, const char *format, va_list args)
+{
+	if (impl_.load(std::memory_order_acquire) == nullptr) {
+		fputs("Logger used without initializing context\n", stderr);
+		return;
+	}
+
+	uint32_t suppressed{0};
+	if (!Admit(format, slask_spy::MonotonicNanoseconds(), &suppressed)) {
+		return;
+	}
+
+	// Claim a record, the ring is bounded so a full one drops the message
+	uint64_t pos{enqueue_pos_.load(std::memory_order_relaxed)};
+	Record *record{nullptr};
+	while (true) {
+		record = &ring_[pos & (kRingRecords - 1)];
+		uint64_t const sequence{
+			record->sequence.load(std::memory_order_acquire)};
+		int64_t const diff{static_cast<int64_t>(sequence - pos)};
+		if (diff == 0) {
+			if (enqueue_pos_.compare_exchange_weak(
+				    pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		} else {
+			pos = enqueue_pos_.load(std::memory_order_relaxed);
+		}
+	}
+
+	record->level = level;
+	record->suppressed = suppressed;
+	vsnprintf(record->text, sizeof(record->text), format, args);
+	record->sequence.store(pos + 1, std::memory_order_release);
+	wake_.notify_one();
+}
+
+bool Logger::Admit(const char *format, uint64_t now_ns, uint32_t *suppressed)
+{
+	std::atomic<uint64_t> &slot{FindRateSlot(format).state};
+	uint64_t const window{now_ns / kRateWindowNs};
+
+	uint64_t state{slot.load(std::memory_order_relaxed)};
+	while (true) {
+		uint64_t const count{state & kRateCountMask};
+		uint64_t next{0};
+		if ((state >> kRateCountBits) != window) {
+			next = (window << kRateCountBits) | 1;
+		} else if (count < kRateCountMask) {
+			next = state + 1;
+		} else {
+			return false;
+		}
+
+		if (!slot.compare_exchange_weak(state, next,
+						std::memory_order_relaxed)) {
+			continue;
+		}
+
+		if ((state >> kRateCountBits) != window) {
+			// count is what the previous window tried to log
+			uint64_t const over{
+				count > kRateBurst ? count - kRateBurst : 0};
+			*suppressed = static_cast<uint32_t>(over);
+			return true;
+		}
+		return count < kRateBurst;
+	}
+}
+
+Logger::RateSlot &Logger::FindRateSlot(const char *format)
+{
+	// Formats are literals, so the address identifies the call site
+	uintptr_t const address{reinterpret_cast<uintptr_t>(format)};
+	size_t const home{static_cast<size_t>(address >> 4)};
+	for (size_t i{0}; i < kRateProbes; ++i) {
+		RateSlot &slot{rate_[(home + i) % kRateSlots]};
+		const char *owner{slot.format.load(std::memory_order_relaxed)};
+		if (owner == nullptr &&
+		    slot.format.compare_exchange_strong(
+			    owner, format, std::memory_order_relaxed)) {
+			return slot;
+		}
+		// Also reached when another thread claimed it for this format
+		if (owner == format) {
+			return slot;
+		}
+	}
+	return rate_[kRateSlots];
+}
+
+void Logger::Run()
+{
+	while (true) {
+		if (Flush()) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock{mutex_};
+		if (!running_) {
+			break;
+		}
+		wake_.wait_for(lock,
+			       std::chrono::milliseconds(kFlushIntervalMilli));
+	}
+
+	// Whatever was logged before Stop
+	Flush();
+}
+
+bool Logger::Flush()
+{
+	bool wrote{false};
+	uint64_t const dropped{dropped_.exchange(0, std::memory_order_relaxed)};
+	if (dropped > 0) {
+		char message[64]{};
+		snprintf(message, sizeof(message),
+			 "logger: Dropped %llu messages, the queue was full",
+			 static_cast<unsigned long long>(dropped));
+		Emit(LogLevel::kWarn, message);
+		wrote = true;
+	}
+
+	while (true) {
+		Record &record{ring_[dequeue_pos_ & (kRingRecords - 1)]};
+		if (record.sequence.load(std::memory_order_acquire) !=
+		    dequeue_pos_ + 1) {
+			return wrote;
+		}
+
+		if (record.suppressed > 0) {
+			char message[64]{};
+			snprintf(message, sizeof(message),
+				 "logger: Suppressed %u repeated messages",
+				 record.suppressed);
+			Emit(record.level, message);
+		}
+		Emit(record.level, record.text);
+
+		record.sequence.store(dequeue_pos_ + kRingRecords,
+				      std::memory_order_release);
+		++dequeue_pos_;
+		wrote = true;
+	}
+}
+
+void Logger::Emit(LogLevel level, const char *message) const
+{
+	LoggerImpl const *const impl{impl_.load(std::memory_order_acquire)};
+	if (impl == nullptr) {
+		return;
+	}
+
+	switch (level) {
+	case LogLevel::kInfo:
+		impl->Info(message);
+		break;
+	case LogLevel::kWarn:
+		impl->Warn(message);
+		break;
+	case LogLevel::kError:
+	case LogLevel::kNone:
+		impl->Error(message);
+		break;
+	}
+}
@@ -0,0 +1,113 @@
+#include "mapped_file.h"
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace slask_spy {
+MappedFile::MappedFile() : data_{nullptr}, size_{0} {}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(std::string const &path)
+{
+	Close();
+	HANDLE const file{CreateFileA(path.c_str(), GENERIC_READ,
+				      FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+				      FILE_FLAG_SEQUENTIAL_SCAN, nullptr)};
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return false;
+	}
+	// Empty files cannot be mapped
+	if (size.QuadPart == 0) {
+		CloseHandle(file);
+		return true;
+	}
+
+	// The view keeps the mapping alive, neither handle is needed after
+	HANDLE const mapping{CreateFileMappingA(file, nullptr, PAGE_READONLY, 0,
+						0, nullptr)};
+	CloseHandle(file);
+	if (mapping == nullptr) {
+		return false;
+	}
+	void *const view{MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)};
+	CloseHandle(mapping);
+	if (view == nullptr) {
+		return false;
+	}
+
+	data_ = static_cast<char const *>(view);
+	size_ = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data_ != nullptr) {
+		UnmapViewOfFile(data_);
+	}
+	data_ = nullptr;
+	size_ = 0;
+}
+#else
+bool MappedFile::Open(std::string const &path)
+{
+	Close();
+	int const fd{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+	if (fd == -1) {
+		return false;
+	}
+
+	struct stat status {};
+	if (fstat(fd, &status) != 0) {
+		close(fd);
+		return false;
+	}
+	// Empty files cannot be mapped
+	if (status.st_size == 0) {
+		close(fd);
+		return true;
+	}
+
+	// The mapping outlives the descriptor
+	size_t const size{static_cast<size_t>(status.st_size)};
+	void *const view{mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)};
+	close(fd);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+
+	data_ = static_cast<char const *>(view);
+	size_ = size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data_ != nullptr) {
+		munmap(const_cast<char *>(data_), size_);
+	}
+	data_ = nullptr;
+	size_ = 0;
+}
+#endif
+} // namespace slask_spy
@@ -0,0 +1,117 @@
+#include "port_catalog.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <poll.h>
+#endif
+
+namespace com_ports {
+namespace {
+constexpr int32_t kRefreshIntervalMilli{10'000};
+} // namespace
+
+PortCatalog &PortCatalog::Instance()
+{
+	static PortCatalog catalog{};
+	return catalog;
+}
+
+PortCatalog::PortCatalog()
+	: ports_{std::make_shared<std::vector<ComPortData> const>()},
+	  enumerated_{false},
+	  wake_{},
+	  running_{false},
+	  thread_{nullptr},
+	  hotplug_{nullptr}
+{
+}
+
+PortCatalog::~PortCatalog()
+{
+	Stop();
+}
+
+void PortCatalog::Start()
+{
+	if (thread_ != nullptr) {
+		return;
+	}
+
+	hotplug_ = new HotplugMonitor([this]() { wake_.Signal(); }, true);
+	running_ = true;
+	thread_ = new std::thread([this]() { Run(); });
+}
+
+void PortCatalog::Stop()
+{
+	if (thread_ == nullptr) {
+		return;
+	}
+
+	running_ = false;
+	wake_.Signal();
+	thread_->join();
+	delete thread_;
+	thread_ = nullptr;
+
+	// Waits for Windows callbacks in progress, which only signal wake_
+	delete hotplug_;
+	hotplug_ = nullptr;
+}
+
+PortCatalog::PortList PortCatalog::Ports() const
+{
+	std::lock_guard<std::mutex> lock{mutex_};
+	return ports_;
+}
+
+void PortCatalog::Run()
+{
+	while (running_) {
+		// Enumerate outside the lock, readers keep the previous list
+		PortList ports{std::make_shared<std::vector<ComPortData> const>(
+			FetchCOMPorts())};
+		{
+			std::lock_guard<std::mutex> lock{mutex_};
+			std::swap(ports_, ports);
+		}
+		enumerated_ = true;
+		Wait();
+	}
+}
+
+void PortCatalog::Wait()
+{
+#ifdef _WIN32
+	WaitForSingleObject(wake_.Handle(), kRefreshIntervalMilli);
+#else
+	pollfd fds[2]{};
+	nfds_t count{1};
+	fds[0].fd = wake_.Handle();
+	fds[0].events = POLLIN;
+#ifdef __linux__
+	if (hotplug_->Handle() != -1) {
+		fds[1].fd = hotplug_->Handle();
+		fds[1].events = POLLIN;
+		count = 2;
+	}
+#endif
+	poll(fds, count, kRefreshIntervalMilli);
+#ifdef __linux__
+	if (fds[1].revents & POLLIN) {
+		// Signals wake_, which is cleared below
+		hotplug_->Drain();
+	}
+#endif
+#endif
+	wake_.Clear();
+}
+} // namespace com_ports
@@ -0,0 +1,35 @@
+#include "reconnect_backoff.h"
+
+#include <cstdint>
+
+namespace com_ports {
+void ReconnectBackoff::Lost(uint64_t now_ns)
+{
+	disconnected_ = true;
+	attempts_ = 0;
+	delay_ns_ = kMinDelay;
+	next_attempt_ns_ = now_ns;
+}
+
+void ReconnectBackoff::AttemptFailed(uint64_t now_ns)
+{
+	++attempts_;
+	next_attempt_ns_ = now_ns + delay_ns_;
+	delay_ns_ = delay_ns_ * 2 < kMaxDelay ? delay_ns_ * 2 : kMaxDelay;
+}
+
+void ReconnectBackoff::DeviceArrived(uint64_t now_ns)
+{
+	// The node can appear before its permissions are set, the short delay
+	// covers the attempt that fails because of that
+	delay_ns_ = kMinDelay;
+	next_attempt_ns_ = now_ns;
+}
+
+void ReconnectBackoff::Restored()
+{
+	disconnected_ = false;
+	attempts_ = 0;
+	delay_ns_ = kMinDelay;
+}
+} // namespace com_ports
@@ -0,0 +1,84 @@
+#include "scene_arena.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace slask_spy {
+SceneArena::SceneArena(size_t capacity)
+	: block_{capacity > 0 ? new std::byte[capacity] : nullptr},
+	  capacity_{capacity},
+	  used_{0},
+	  requested_{0},
+	  finalizers_{nullptr},
+	  overflow_{}
+{
+}
+
+SceneArena::~SceneArena()
+{
+	Reset();
+	delete[] block_;
+}
+
+void *SceneArena::Allocate(size_t size, size_t alignment)
+{
+	requested_ += size + alignment - 1;
+
+	uintptr_t const base{reinterpret_cast<uintptr_t>(block_)};
+	uintptr_t const aligned{(base + used_ + alignment - 1) &
+				~(uintptr_t{alignment} - 1)};
+	size_t const offset{static_cast<size_t>(aligned - base)};
+	if (block_ != nullptr && offset + size <= capacity_) {
+		used_ = offset + size;
+		return block_ + offset;
+	}
+
+	// new[] only guarantees fundamental alignment, over-allocate to align
+	std::byte *const overflow{new std::byte[size + alignment - 1]};
+	overflow_.push_back(overflow);
+	uintptr_t const start{reinterpret_cast<uintptr_t>(overflow)};
+	return overflow + (((start + alignment - 1) &
+			    ~(uintptr_t{alignment} - 1)) -
+			   start);
+}
+
+void *SceneArena::do_allocate(size_t size, size_t alignment)
+{
+	return Allocate(size, alignment);
+}
+
+// Nothing to do, the memory comes back with Reset
+void SceneArena::do_deallocate(void *, size_t, size_t)
+{
+}
+
+bool SceneArena::do_is_equal(
+	std::pmr::memory_resource const &other) const noexcept
+{
+	return this == &other;
+}
+
+void SceneArena::Reset()
+{
+	// Newest first, later objects may refer to earlier ones
+	for (Finalizer *it{finalizers_}; it != nullptr; it = it->next) {
+		it->destroy(it->object);
+	}
+	finalizers_ = nullptr;
+
+	for (std::byte *it : overflow_) {
+		delete[] it;
+	}
+
+	if (!overflow_.empty() && requested_ > capacity_) {
+		delete[] block_;
+		block_ = new std::byte[requested_];
+		capacity_ = requested_;
+	}
+	overflow_.clear();
+	used_ = 0;
+	requested_ = 0;
+}
+} // namespace slask_spy
@@ -0,0 +1,42 @@
+#include "skin_catalog.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace slask_spy {
+SkinCatalog::SkinCatalog(std::string index_path)
+	: refresh_mutex_{},
+	  index_{std::move(index_path)},
+	  mutex_{},
+	  skins_{}
+{
+}
+
+SkinCatalog::SkinList SkinCatalog::Refresh(std::string const &skins_directory)
+{
+	std::lock_guard<std::mutex> refresh_lock{refresh_mutex_};
+
+	// Scanned outside mutex_, readers keep the previous list meanwhile
+	std::shared_ptr<SkinMap> const skins{std::make_shared<SkinMap>()};
+	SkinSettings::FetchSkins(skins_directory, index_, *skins);
+	SkinList const list{skins};
+
+	std::lock_guard<std::mutex> lock{mutex_};
+	skins_.insert_or_assign(skins_directory, list);
+	return list;
+}
+
+SkinCatalog::SkinList SkinCatalog::Get(std::string const &skins_directory)
+{
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		auto const it{skins_.find(skins_directory)};
+		if (it != skins_.end() && !it->second->empty()) {
+			return it->second;
+		}
+	}
+	return Refresh(skins_directory);
+}
+} // namespace slask_spy
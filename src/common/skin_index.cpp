@@ -0,0 +1,393 @@
+#include "skin_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "logger.h"
+#include "mapped_file.h"
+#include "work_pool.h"
+
+namespace slask_spy {
+namespace {
+namespace fs = std::filesystem;
+
+// Bump the version whenever the layout below changes, older files are
+// then ignored and rebuilt
+constexpr std::string_view kHeader{"slaskspy-skin-index 2"};
+
+// One record per line with tab separated fields:
+//   root  <path>                     (starts the entries of a library)
+//   skin  <path> <mtime> <size> <types> <name> <author>
+//   bg    <name> <image>             (backgrounds of the skin above)
+//   dir   <path> <mtime>
+//   child <name>                     (subfolders of the dir above)
+// Types are ViewerType values separated by ','.
+
+std::vector<std::string_view> SplitFields(std::string_view line)
+{
+	std::vector<std::string_view> fields{};
+	while (true) {
+		size_t const tab{line.find('\t')};
+		fields.push_back(line.substr(0, tab));
+		if (tab == std::string_view::npos) {
+			return fields;
+		}
+		line.remove_prefix(tab + 1);
+	}
+}
+
+template<typename T> bool ParseNumber(std::string_view text, T *value)
+{
+	char const *const last{text.data() + text.size()};
+	auto const [end, error]{std::from_chars(text.data(), last, *value)};
+	return error == std::errc{} && end == last && !text.empty();
+}
+
+// Fields holding a separator would corrupt the file, such entries are
+// left out and parsed again on the next refresh
+bool Storable(std::string_view field)
+{
+	return field.find_first_of("\t\r\n") == std::string_view::npos;
+}
+
+bool Storable(SkinIndex::Entry const &entry)
+{
+	if (!entry.is_skin) {
+		for (std::string const &child : entry.children) {
+			if (!Storable(child)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	SkinData const &data{*entry.data};
+	if (!Storable(data.name) || !Storable(data.author)) {
+		return false;
+	}
+	for (BackgroundData const &background : data.backgrounds) {
+		if (!Storable(background.name) || !Storable(background.image)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int64_t WriteTime(fs::path const &path, std::error_code &error)
+{
+	return static_cast<int64_t>(
+		fs::last_write_time(path, error).time_since_epoch().count());
+}
+
+void WriteEntries(std::ofstream &file,
+		  std::map<std::string, SkinIndex::Entry> const &entries)
+{
+	for (auto const &[path, entry] : entries) {
+		if (!Storable(path) || !Storable(entry)) {
+			continue;
+		}
+
+		if (!entry.is_skin) {
+			file << "dir\t" << path << '\t' << entry.mtime << '\n';
+			for (std::string const &child : entry.children) {
+				file << "child\t" << child << '\n';
+			}
+			continue;
+		}
+
+		file << "skin\t" << path << '\t' << entry.mtime << '\t'
+		     << entry.size << '\t';
+		for (size_t i{0}; i < entry.types.size(); ++i) {
+			file << (i > 0 ? "," : "")
+			     << static_cast<int32_t>(entry.types[i]);
+		}
+		file << '\t' << entry.data->name << '\t' << entry.data->author
+		     << '\n';
+		for (BackgroundData const &background :
+		     entry.data->backgrounds) {
+			file << "bg\t" << background.name << '\t'
+			     << background.image << '\n';
+		}
+	}
+}
+} // namespace
+
+struct SkinIndex::ScanState {
+	// Only looked up while scanning, each task moves out of the entry for
+	// its own path at most
+	std::map<std::string, Entry> &previous;
+	WorkGroup group;
+	std::mutex mutex;
+	std::vector<std::pair<std::string, Entry>> found;
+	std::atomic<bool> changed;
+};
+
+SkinIndex::SkinIndex(std::string index_path)
+	: kIndexPath{std::move(index_path)},
+	  loaded_{false},
+	  roots_{}
+{
+}
+
+bool SkinIndex::Refresh(std::string const &skins_directory)
+{
+	if (!loaded_) {
+		Load();
+		loaded_ = true;
+	}
+
+	std::error_code error{};
+	if (!fs::is_directory(skins_directory, error)) {
+		return false;
+	}
+
+	// A library scanned for the first time finds every folder changed
+	std::map<std::string, Entry> &entries{roots_[skins_directory]};
+	std::map<std::string, Entry> previous{};
+	previous.swap(entries);
+
+	ScanState state{previous, WorkGroup{WorkPool::Instance()}, {}, {},
+			false};
+	Scan(skins_directory, true, {}, state);
+	state.group.Wait();
+
+	// Whatever was not found again is gone from disk
+	for (auto &[path, entry] : state.found) {
+		previous.erase(path);
+		entries.insert_or_assign(std::move(path), std::move(entry));
+	}
+	if (state.changed || !previous.empty()) {
+		Save();
+	}
+	return true;
+}
+
+std::map<std::string, SkinIndex::Entry> const &
+SkinIndex::Entries(std::string const &skins_directory) const
+{
+	static std::map<std::string, Entry> const kNone{};
+	auto const it{roots_.find(skins_directory)};
+	return it != roots_.end() ? it->second : kNone;
+}
+
+void SkinIndex::Scan(std::string const &path, bool is_root,
+		     std::vector<std::string> ancestors, ScanState &state)
+{
+	std::error_code error{};
+	auto const old{state.previous.find(path)};
+	bool const known{old != state.previous.end()};
+
+	// The library root itself is never a skin
+	if (!is_root) {
+		fs::path const skin_xml{fs::path(path) / "skin.xml"};
+		uintmax_t const size{fs::file_size(skin_xml, error)};
+		int64_t const mtime{error ? 0 : WriteTime(skin_xml, error)};
+		if (!error) {
+			Entry entry{mtime, size, true, {}, {}, {}};
+			if (known && old->second.is_skin &&
+			    old->second.mtime == mtime &&
+			    old->second.size == size) {
+				entry = std::move(old->second);
+			} else {
+				auto [types, key, data]{
+					SkinSettings::GetSkinData(path)};
+				if (data != nullptr) {
+					entry.types = std::move(types);
+					entry.data.reset(data);
+				} else {
+					entry.data =
+						std::make_shared<SkinData>();
+				}
+				state.changed = true;
+			}
+
+			std::lock_guard<std::mutex> lock{state.mutex};
+			state.found.emplace_back(path, std::move(entry));
+			return;
+		}
+	}
+
+	// A symlink back up the tree would be scanned forever. Checked
+	// against the folders above only, so which path a folder reached
+	// twice is listed under does not depend on scan order.
+	std::string canonical{fs::canonical(path, error).string()};
+	if (error || std::find(ancestors.begin(), ancestors.end(),
+			       canonical) != ancestors.end()) {
+		return;
+	}
+	ancestors.push_back(std::move(canonical));
+
+	int64_t const mtime{WriteTime(path, error)};
+	if (error) {
+		return;
+	}
+
+	Entry entry{mtime, 0, false, {}, {}, {}};
+	if (known && !old->second.is_skin && old->second.mtime == mtime) {
+		entry.children = std::move(old->second.children);
+	} else {
+		fs::directory_iterator it{
+			path, fs::directory_options::skip_permission_denied,
+			error};
+		for (; !error && it != fs::directory_iterator{};
+		     it.increment(error)) {
+			// Follows symlinks
+			std::error_code type_error{};
+			if (it->is_directory(type_error)) {
+				entry.children.push_back(
+					it->path().filename().string());
+			}
+		}
+		std::sort(entry.children.begin(), entry.children.end());
+		state.changed = true;
+	}
+
+	for (std::string const &child : entry.children) {
+		std::string child_path{(fs::path(path) / child).string()};
+		state.group.Submit([child_path = std::move(child_path),
+				    ancestors, &state]() {
+			Scan(child_path, false, ancestors, state);
+		});
+	}
+
+	std::lock_guard<std::mutex> lock{state.mutex};
+	state.found.emplace_back(path, std::move(entry));
+}
+
+void SkinIndex::Load()
+{
+	MappedFile file{};
+	if (kIndexPath.empty() || !file.Open(kIndexPath)) {
+		return;
+	}
+
+	std::string_view text{file.Contents()};
+	std::map<std::string, std::map<std::string, Entry>> roots{};
+	std::map<std::string, Entry> *entries{nullptr};
+	Entry *current{nullptr};
+	// Data of the skin above, shared as const once in the entry
+	SkinData *current_data{nullptr};
+	bool header{false};
+	bool valid{true};
+
+	while (!text.empty() && valid) {
+		size_t const end{text.find('\n')};
+		std::string_view const line{text.substr(0, end)};
+		text.remove_prefix(end == std::string_view::npos ? text.size()
+								 : end + 1);
+		if (!header) {
+			header = line == kHeader;
+			valid = header;
+			continue;
+		}
+
+		std::vector<std::string_view> const fields{SplitFields(line)};
+		std::string_view const kind{fields[0]};
+		if (kind == "root" && fields.size() == 2) {
+			entries = &roots[std::string(fields[1])];
+			current = nullptr;
+		} else if (entries == nullptr) {
+			valid = false;
+		} else if (kind == "skin" && fields.size() == 7) {
+			Entry entry{0, 0, true, {}, {}, {}};
+			valid = ParseNumber(fields[2], &entry.mtime) &&
+				ParseNumber(fields[3], &entry.size);
+			std::string_view types{fields[4]};
+			while (valid && !types.empty()) {
+				size_t const comma{types.find(',')};
+				int32_t type{0};
+				valid = ParseNumber(types.substr(0, comma),
+						    &type);
+				entry.types.push_back(
+					static_cast<ViewerType>(type));
+				types.remove_prefix(
+					comma == std::string_view::npos
+						? types.size()
+						: comma + 1);
+			}
+			std::shared_ptr<SkinData> data{
+				std::make_shared<SkinData>()};
+			data->name = fields[5];
+			data->author = fields[6];
+			current_data = data.get();
+			entry.data = std::move(data);
+			current = &entries->insert_or_assign(
+						  std::string(fields[1]),
+						  std::move(entry))
+					   .first->second;
+		} else if (kind == "bg" && fields.size() == 3 &&
+			   current != nullptr && current->is_skin) {
+			current_data->backgrounds.push_back(BackgroundData{
+				std::string(fields[1]),
+				std::string(fields[2])});
+		} else if (kind == "dir" && fields.size() == 3) {
+			Entry entry{0, 0, false, {}, {}, {}};
+			valid = ParseNumber(fields[2], &entry.mtime);
+			current = &entries->insert_or_assign(
+						  std::string(fields[1]),
+						  std::move(entry))
+					   .first->second;
+		} else if (kind == "child" && fields.size() == 2 &&
+			   current != nullptr && !current->is_skin) {
+			current->children.emplace_back(fields[1]);
+		} else if (!line.empty()) {
+			valid = false;
+		}
+	}
+
+	if (!valid) {
+		Logger::Warn("skin_index: Ignoring invalid index %s",
+			     kIndexPath.c_str());
+		return;
+	}
+	roots_ = std::move(roots);
+}
+
+void SkinIndex::Save() const
+{
+	if (kIndexPath.empty()) {
+		return;
+	}
+
+	// Written aside and renamed over, a crash never leaves half an index
+	std::string const temporary{kIndexPath + ".tmp"};
+	{
+		std::ofstream file{temporary, std::ios::trunc};
+		if (!file.is_open()) {
+			Logger::Warn("skin_index: Could not write %s",
+				     temporary.c_str());
+			return;
+		}
+
+		file << kHeader << '\n';
+		for (auto const &[root, entries] : roots_) {
+			// Left out with its entries, they are rescanned
+			if (!Storable(root)) {
+				continue;
+			}
+			file << "root\t" << root << '\n';
+			WriteEntries(file, entries);
+		}
+	}
+
+	std::error_code error{};
+	fs::rename(temporary, kIndexPath, error);
+	if (error) {
+		Logger::Warn("skin_index: Could not replace %s",
+			     kIndexPath.c_str());
+	}
+}
+} // namespace slask_spy
@@ -1,86 +1,48 @@
 #include "skin_settings.h"
 
-#include <sys/stat.h>
-
-#include <filesystem>
-#include <fstream>
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <string>
 #include <string_view>
 #include <tuple>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
+#include "custom_protocol.h"
 #include "logger.h"
+#include "mapped_file.h"
+#include "scene_arena.h"
+#include "skin_index.h"
 #include "viewer.h"
+#include "xml_tokenizer.h"
 
 namespace slask_spy {
 
 bool SkinSettings::FetchSkins(
-	std::string const &skins_directory,
-	std::unordered_map<ViewerType, std::map<std::string, SkinData *>> &skins)
+	std::string const &skins_directory, SkinIndex &index,
+	std::unordered_map<
+		ViewerType,
+		std::map<std::string, std::shared_ptr<SkinData const>>> &skins)
 {
-	// Clean up old skins
-	{
-		std::unordered_set<SkinData *> ptrs{};
-		for (auto const &entry : skins) {
-			for (auto const &pair : entry.second) {
-				SkinData *skin_ptr{pair.second};
-				if (ptrs.find(skin_ptr) == ptrs.end()) {
-					delete skin_ptr;
-					ptrs.insert(skin_ptr);
-				}
-			}
-		}
-	}
 	skins.clear();
 
-	{
-		struct stat sb {
-			0
-		};
-		if (stat(skins_directory.c_str(), &sb) != 0) {
-			Logger::Info("skin_settings: Invalid path: %s",
-				     skins_directory);
-			return false;
-		}
+	if (!index.Refresh(skins_directory)) {
+		Logger::Info("skin_settings: Invalid path: %s",
+			     skins_directory.c_str());
+		return false;
 	}
 
-	std::filesystem::path skin_dir{skins_directory};
-
-	for (auto &path :
-	     std::filesystem::recursive_directory_iterator(skin_dir)) {
-		if (path.is_directory()) {
-			bool added{false};
-			auto const data = GetSkinData(path.path().string());
-			auto const types = std::get<0>(data);
-
-			for (auto type : types) {
-				if (type != ViewerType::kNull) {
-					auto it = skins.find(type);
-					if (it == skins.end()) {
-						skins[type] =
-							std::map<std::string, SkinData*>{};
-					}
-					std::string const &name{
-						std::get<1>(data)};
-					
-					if (skins[type].find(name) !=
-					    skins[type].end()) {
-						Logger::Warn(
-							"Duplicate skin found: %s, discarding",
-							name);
-						continue;
-					}
-					skins[type][name] = std::get<2>(data);
-					added = true;
-				}
-			}
+	// One SkinData per skin, shared by every type it supports
+	for (auto const &[path, entry] : index.Entries(skins_directory)) {
+		if (!entry.is_skin || entry.types.empty()) {
+			continue;
+		}
 
-			if (!added) {
-				delete std::get<2>(data);
-			}
+		std::string const key{path + "/"};
+		for (ViewerType const type : entry.types) {
+			skins[type].emplace(key, entry.data);
 		}
 	}
 	return skins.size() > 0;
@@ -89,132 +51,86 @@ bool SkinSettings::FetchSkins(
 std::tuple<std::vector<ViewerType>, std::string, SkinData *>
 SkinSettings::GetSkinData(std::string_view skin_path)
 {
-	SkinData *skin{new SkinData()};
 	std::string path{std::string(skin_path) + "/"};
-	std::vector<ViewerType> type{};
-
 	std::string const skin_xml_path{path + "skin.xml"};
-	std::ifstream xml_file{skin_xml_path};
-
-	if (xml_file.is_open()) {
-		std::string line;
-		// Find only the <skin tag, exclude xml tag, empty, return on other lines
-		while (std::getline(xml_file, line)) {
-			// Discard empty lines or the xml tag
-			if (line.empty() ||
-			    line.find("<?xml") != std::string::npos) {
-				continue;
-			}
+	auto const invalid{[&path]() {
+		return std::make_tuple(std::vector<ViewerType>{}, path,
+				       static_cast<SkinData *>(nullptr));
+	}};
 
-			if (line.find("<skin") == std::string::npos) {
-				Logger::Error(
-					"skin_settings: Skin %s is not a valid skin.xml",
-					skin_xml_path.c_str());	
-				delete skin;
-				return std::make_tuple(
-					std::vector<ViewerType>{}, path,
-					nullptr);
-			} 
-
-			break;
-		}
-
-		std::string type_string{};
-
-		try {
-			type_string =
-				GetAttributeValue(line, "type");
-			skin->name = GetAttributeValue(line, "name");
-		} catch (std::exception const& error) {
-			Logger::Error("skin_settings: Attribute failure: %s",
-				      error.what());
-			delete skin;
-			return std::make_tuple(std::vector<ViewerType>{}, path,
-					       nullptr);
-		}
-
-
-		std::string single_type;
-		ViewerType type_value;
-		size_t pos_start{0};
-		size_t pos_end{0};
-
-		while ((pos_end = type_string.find(';', pos_start)) !=
-		       std::string::npos) {
-			single_type = type_string.substr(pos_start,
-							 pos_end - pos_start);
-
-			pos_start = pos_end + sizeof(';');
-			type_value = Viewer::TypeFromString(single_type);
-
-			if (type_value == ViewerType::kNull) {
-				Logger::Warn(
-					"skin_settings: Skin type %s is not implemented. Skin: %s",
-					single_type.c_str(),
-					skin_xml_path.c_str());
-			} else {
-				type.push_back(type_value);
-			}
-		}
+	MappedFile file{};
+	if (!file.Open(skin_xml_path)) {
+		Logger::Warn("skin_settings: Could not open file %s",
+			     skin_xml_path.c_str());
+		return invalid();
+	}
 
-		single_type = type_string.substr(pos_start);
-		type_value = Viewer::TypeFromString(single_type);
+	// <skin> has to be the first element
+	XmlTokenizer tokenizer{file.Contents()};
+	XmlTag tag{};
+	std::string_view type_string{};
+	std::string_view name{};
+	if (!tokenizer.Next(&tag) || tag.closing || tag.name != "skin" ||
+	    !tag.Attribute("type", &type_string) ||
+	    !tag.Attribute("name", &name)) {
+		Logger::Error("skin_settings: Skin %s is not a valid skin.xml",
+			      skin_xml_path.c_str());
+		return invalid();
+	}
 
+	std::vector<ViewerType> type{};
+	while (!type_string.empty()) {
+		size_t const end{type_string.find(';')};
+		std::string_view const single_type{type_string.substr(0, end)};
+		type_string.remove_prefix(end == std::string_view::npos
+						  ? type_string.size()
+						  : end + 1);
+
+		ViewerType const type_value{
+			Viewer::TypeFromString(single_type)};
 		if (type_value == ViewerType::kNull) {
-			Logger::Warn(
-				"skin_settings: Skin type %s is not implemented. Skin: %s",
-				single_type.c_str(), skin_xml_path.c_str());
+			Logger::Warn("skin_settings: Skin type %.*s is not "
+				     "implemented. Skin: %s",
+				     static_cast<int>(single_type.size()),
+				     single_type.data(), skin_xml_path.c_str());
 		} else {
 			type.push_back(type_value);
 		}
+	}
+	if (type.empty()) {
+		return invalid();
+	}
 
-		if (type.size() > 0) {
-			while (std::getline(xml_file, line)) {
-				// Discard empty lines or the xml tag
-				if (line.empty()) {
-					continue;
-				}
-				
-				if (line.find("<background") != std::string::npos) {
-					try {
-						skin->backgrounds.push_back(							
-							BackgroundData{
-								GetAttributeValue(line, "name"),
-								GetAttributeValue(line, "image"),
-							}
-						);
-					} catch (std::exception const &error) {
-						Logger::Error(
-							"skin_settings: Attribute failure: %s",
-							error.what());
-					}
-				} else if (line.find("<background") == std::string::npos) {
-					if (skin->backgrounds.size() == 0) {
-						delete skin;
-						return std::make_tuple(
-							std::vector<ViewerType>{},
-							path,
-							nullptr);
-					} 
-					break;
-				}
-			}
+	// Backgrounds come right after <skin>, stop at the first other tag
+	SkinData *const skin{new SkinData()};
+	skin->name = name;
+	while (tokenizer.Next(&tag) && !tag.closing &&
+	       tag.name == "background") {
+		std::string_view background_name{};
+		std::string_view image{};
+		if (!tag.Attribute("name", &background_name) ||
+		    !tag.Attribute("image", &image)) {
+			Logger::Error("skin_settings: %s: <background> needs a "
+				      "name and an image",
+				      skin_xml_path.c_str());
+			continue;
 		}
+		skin->backgrounds.push_back(BackgroundData{
+			std::string(background_name), std::string(image)});
+	}
 
-	} else {
+	if (skin->backgrounds.empty()) {
 		delete skin;
-		skin = nullptr;
-		Logger::Warn("skin_settings: Could not open file %s",
-			     skin_xml_path.c_str());
+		return invalid();
 	}
-
 	return std::make_tuple(type, path, skin);
 }
 
 SkinSettings *SkinSettings::LoadSkinSettings(std::string_view skin_directory,
 					     ViewerType type)
 {
-	SkinSettings *skin{new SkinSettings(skin_directory, type)};
+	SkinSettings *skin{new SkinSettings(skin_directory, type,
+					    std::pmr::new_delete_resource())};
 	if (!skin->valid_) {
 		delete skin;
 		skin = nullptr;
@@ -223,17 +139,26 @@ SkinSettings *SkinSettings::LoadSkinSettings(std::string_view skin_directory,
 	return skin;
 }
 
-std::vector<ButtonSetting> const &SkinSettings::GetButtonSettings() const
+SkinSettings *SkinSettings::LoadSkinSettings(std::string_view skin_directory,
+					     ViewerType type,
+					     SceneArena &arena)
+{
+	SkinSettings *const skin{
+		arena.Create<SkinSettings>(skin_directory, type, &arena)};
+	return skin->valid_ ? skin : nullptr;
+}
+
+std::pmr::vector<ButtonSetting> const &SkinSettings::GetButtonSettings() const
 {
 	return buttons_;
 }
 
-std::vector<StickSetting> const &SkinSettings::GetStickSettings() const
+std::pmr::vector<StickSetting> const &SkinSettings::GetStickSettings() const
 {
 	return sticks_;
 }
 
-std::vector<AnalogSetting> const &SkinSettings::GetAnalogSettings() const
+std::pmr::vector<AnalogSetting> const &SkinSettings::GetAnalogSettings() const
 {
 	return analogs_;
 }
@@ -243,198 +168,217 @@ std::string_view SkinSettings::GetSkinPath() const
 	return skin_path_;
 }
 
-SkinSettings::SkinSettings(std::string_view skin_directory, ViewerType type)
-	: valid_{false},
-	  skin_path_{skin_directory},
-	  type_{type},
-	  buttons_{},
-	  sticks_{}
+CustomProtocol const *SkinSettings::GetProtocol() const
 {
-	std::ifstream xml_file{skin_path_ + "skin.xml"};
+	return protocol_;
+}
 
-	if (xml_file.is_open()) {
-		std::string line{};
+SkinSettings::~SkinSettings()
+{
+	// Its memory goes with pool_
+	if (protocol_ != nullptr) {
+		protocol_->~CustomProtocol();
+	}
+}
 
-		// First get to after <skin element
-		while (std::getline(xml_file, line)) {
-			// Quickly pass the past lines
-			if (line.find("<background") != std::string::npos) {
-				break;
-			}
+int32_t SkinSettings::MappingIndex(std::string_view name) const
+{
+	if (protocol_ == nullptr) {
+		return Viewer::GetMappingIndex(name, type_);
+	}
+
+	int32_t const index{protocol_->Find(name)};
+	if (index == -1) {
+		Logger::Error("skin_settings: %.*s is not in protocol.xml",
+			      static_cast<int>(name.size()), name.data());
+	}
+	return index;
+}
+
+SkinSettings::SkinSettings(std::string_view skin_directory, ViewerType type,
+			   std::pmr::memory_resource *upstream)
+	: valid_{false},
+	  pool_{upstream},
+	  skin_path_{skin_directory, &pool_},
+	  type_{type},
+	  buttons_{&pool_},
+	  sticks_{&pool_},
+	  analogs_{&pool_},
+	  protocol_{nullptr}
+{
+	if (type_ == ViewerType::kCustom) {
+		protocol_ = CustomProtocol::Load(
+			std::string(skin_path_) + "protocol.xml", &pool_);
+		if (protocol_ == nullptr) {
+			return;
 		}
+	}
 
-		std::string element_line{};
-		while (std::getline(xml_file, line)) {
-			if (line.empty()) {
-				continue;
-			}
+	MappedFile file{};
+	if (!file.Open(std::string(skin_path_) + "skin.xml")) {
+		Logger::Error("skin_settings: Could not open %sskin.xml",
+			      skin_path_.c_str());
+		return;
+	}
 
-			if (line.find("</skin>") != std::string::npos) {
+	// Every element is a single tag, however it is laid out
+	XmlTokenizer tokenizer{file.Contents()};
+	XmlTag tag{};
+	while (tokenizer.Next(&tag)) {
+		if (tag.closing) {
+			if (tag.name == "skin") {
 				valid_ = true;
-				break;
+				return;
 			}
+			continue;
+		}
 
-			if (line.find("<") != std::string::npos) {
-				element_line = line;
-				if (line.find("/>") == std::string::npos) {
-					continue;
-				}
-			} else if (line.find("/>") != std::string::npos) {
-				if (line.find("<") != std::string::npos) {
-					break;
-				}
-				element_line += line;
-			}
-			
-
-			if (element_line.find("<button") != std::string::npos) {
-				if (!CreateButtonSetting(element_line)) {
-					break;
-				}
-			} else if (element_line.find("<stick") !=
-				   std::string::npos) {
-				if (!CreateStickSetting(element_line)) {
-					break;
-				}
-			} else if (element_line.find("<analog") !=
-				   std::string::npos) {
-				if (!CreateAnalogSetting(element_line)) {
-					break;
-				}
-			} 
-			element_line = "";
+		bool created{true};
+		if (tag.name == "button") {
+			created = CreateButtonSetting(tag);
+		} else if (tag.name == "stick") {
+			created = CreateStickSetting(tag);
+		} else if (tag.name == "analog") {
+			created = CreateAnalogSetting(tag);
+		}
+		if (!created) {
+			return;
 		}
 	}
+
+	Logger::Error("skin_settings: %sskin.xml ends before </skin>",
+		      skin_path_.c_str());
 }
 
-bool SkinSettings::CreateAnalogSetting(std::string const &line)
+bool SkinSettings::ReadCommonSetting(XmlTag const &tag,
+				     CommonSetting *common)
 {
-	try {
-		CommonSetting const common{
-			std::stoi(GetAttributeValue(line, "x")),
-			std::stoi(GetAttributeValue(line, "y")),
-			std::stoi(GetAttributeValue(line, "width")) + 1,
-			std::stoi(GetAttributeValue(line, "height")) + 1,
-			GetAttributeValue(line, "image")};
-
-		int32_t const index{Viewer::GetMappingIndex(
-			GetAttributeValue(line, "name"), type_)};
-
-		if (index == -1) {
-			return false;
-		}
+	std::string_view image{};
+	if (!ReadInt(tag, "x", &common->x) || !ReadInt(tag, "y", &common->y) ||
+	    !ReadInt(tag, "width", &common->width) ||
+	    !ReadInt(tag, "height", &common->height) ||
+	    !ReadString(tag, "image", &image)) {
+		return false;
+	}
+	common->width += 1;
+	common->height += 1;
+	// The tag points into the mapped skin.xml, which is closed after
+	// parsing
+	char *const name{static_cast<char *>(pool_.allocate(image.size(), 1))};
+	std::copy(image.begin(), image.end(), name);
+	common->image = std::string_view(name, image.size());
+	return true;
+}
 
-		static std::unordered_map<std::string_view, AnalogDirection> const
-			kAnalogDirection{{"right", AnalogDirection::kRight},
-					 {"left", AnalogDirection::kLeft},
-					 {"down", AnalogDirection::kDown},
-					 {"up", AnalogDirection::kUp}};
-
-		auto const &analog_dir = GetAttributeValue(line, "direction");
-		auto const &analog_it = kAnalogDirection.find(analog_dir);
-		if (analog_it == kAnalogDirection.end()) {
-			Logger::Error(
-				"skin_settings: Invalid analog direction: %s",
-				analog_dir.c_str());
-			return false;
-		};
-		static std::unordered_map<std::string_view, bool> const
-			kReverse{{"true", true}, {"false", false}};
-		auto const &reverse = GetAttributeValue(line, "reverse");
-		auto const &reverse_it = kReverse.find(reverse);
-		if (reverse_it == kReverse.end()) {
-			Logger::Error(
-				"skin_settings: Invalid reverse value: %s",
-				reverse.c_str());
-			return false;
-		}
+bool SkinSettings::ReadInt(XmlTag const &tag, std::string_view name,
+			   int32_t *value) const
+{
+	if (tag.IntAttribute(name, value)) {
+		return true;
+	}
+	Logger::Error("skin_settings: %sskin.xml: <%.*s> needs an integer %.*s",
+		      skin_path_.c_str(), static_cast<int>(tag.name.size()),
+		      tag.name.data(), static_cast<int>(name.size()),
+		      name.data());
+	return false;
+}
 
-		analogs_.push_back(AnalogSetting{
-			common, index, analog_it->second, reverse_it->second});
+bool SkinSettings::ReadString(XmlTag const &tag, std::string_view name,
+			      std::string_view *value) const
+{
+	if (tag.Attribute(name, value)) {
 		return true;
-	} catch (std::exception const & error) {
-		Logger::Error("skin_settings: Analog error: %s", error.what());
-		return false;
 	}
+	Logger::Error("skin_settings: %sskin.xml: <%.*s> needs a %.*s",
+		      skin_path_.c_str(), static_cast<int>(tag.name.size()),
+		      tag.name.data(), static_cast<int>(name.size()),
+		      name.data());
+	return false;
 }
 
-bool SkinSettings::CreateButtonSetting(std::string const &line)
+bool SkinSettings::CreateAnalogSetting(XmlTag const &tag)
 {
-	try {
-		CommonSetting const common{
-			std::stoi(GetAttributeValue(line, "x")),
-			std::stoi(GetAttributeValue(line, "y")),
-			std::stoi(GetAttributeValue(line, "width")) + 1,
-			std::stoi(GetAttributeValue(line, "height")) + 1,
-			GetAttributeValue(line, "image")};
-
-		int32_t const index{Viewer::GetMappingIndex(
-			GetAttributeValue(line, "name"), type_)};
-
-		if (index == -1) {
-			return false;
-		}
+	AnalogSetting analog{};
+	std::string_view name{};
+	std::string_view direction{};
+	std::string_view reverse{};
+	if (!ReadCommonSetting(tag, &analog) ||
+	    !ReadString(tag, "name", &name) ||
+	    !ReadString(tag, "direction", &direction) ||
+	    !ReadString(tag, "reverse", &reverse)) {
+		return false;
+	}
 
-		buttons_.push_back(ButtonSetting{common, index});
-		return true;
-	} catch (std::exception const & error) {
-		Logger::Error("skin_settings: Button error: %s", error.what());
+	analog.index = MappingIndex(name);
+	if (analog.index == -1) {
+		return false;
+	}
+
+	if (direction == "right") {
+		analog.direction = AnalogDirection::kRight;
+	} else if (direction == "left") {
+		analog.direction = AnalogDirection::kLeft;
+	} else if (direction == "down") {
+		analog.direction = AnalogDirection::kDown;
+	} else if (direction == "up") {
+		analog.direction = AnalogDirection::kUp;
+	} else {
+		Logger::Error("skin_settings: Invalid analog direction: %.*s",
+			      static_cast<int>(direction.size()),
+			      direction.data());
 		return false;
 	}
+
+	if (reverse != "true" && reverse != "false") {
+		Logger::Error("skin_settings: Invalid reverse value: %.*s",
+			      static_cast<int>(reverse.size()), reverse.data());
+		return false;
+	}
+	analog.reverse = reverse == "true";
+
+	analogs_.push_back(analog);
+	return true;
 }
 
-bool SkinSettings::CreateStickSetting(std::string const &line)
+bool SkinSettings::CreateButtonSetting(XmlTag const &tag)
 {
-	try {
-		CommonSetting const common{
-			std::stoi(GetAttributeValue(line, "x")),
-			std::stoi(GetAttributeValue(line, "y")),
-			std::stoi(GetAttributeValue(line, "width")) + 1,
-			std::stoi(GetAttributeValue(line, "height")) + 1,
-			GetAttributeValue(line, "image")};
-
-		int32_t const x_index{Viewer::GetMappingIndex(
-			GetAttributeValue(line, "xname"), type_)};
-		int32_t const y_index{Viewer::GetMappingIndex(
-			GetAttributeValue(line, "yname"), type_)};
-
-		if (x_index == -1 || y_index == -1) {
-			return false;
-		}
+	ButtonSetting button{};
+	std::string_view name{};
+	if (!ReadCommonSetting(tag, &button) ||
+	    !ReadString(tag, "name", &name)) {
+		return false;
+	}
 
-		sticks_.push_back(StickSetting{
-			common, std::stoi(GetAttributeValue(line, "xrange")),
-			std::stoi(GetAttributeValue(line, "yrange")), x_index,
-			y_index});
-		return true;
-	} catch (std::exception const & error) {
-		Logger::Error("skin_settings: Stick error: %s", error.what());
+	button.index = MappingIndex(name);
+	if (button.index == -1) {
 		return false;
 	}
+
+	buttons_.push_back(button);
+	return true;
 }
 
-std::string SkinSettings::GetAttributeValue(std::string const &line,
-					    std::string const &name)
+bool SkinSettings::CreateStickSetting(XmlTag const &tag)
 {
-	size_t attribute_pos{line.find(name + "=")};
-	if (attribute_pos == std::string::npos) {
-		std::string const err{"Element " + line +
-				      " does not contain attribute " + name};
-		throw std::exception(err.c_str());
+	StickSetting stick{};
+	std::string_view x_name{};
+	std::string_view y_name{};
+	if (!ReadCommonSetting(tag, &stick) ||
+	    !ReadString(tag, "xname", &x_name) ||
+	    !ReadString(tag, "yname", &y_name) ||
+	    !ReadInt(tag, "xrange", &stick.x_range) ||
+	    !ReadInt(tag, "yrange", &stick.y_range)) {
+		return false;
 	}
 
-	size_t const attribute_start{line.find("\"", attribute_pos)};
-	size_t const attribute_end{line.find("\"", attribute_start + 1)};
-
-	if (attribute_start == std::string::npos ||
-	    attribute_end == std::string::npos) {
-		std::string const err{"Element " + line +
-				      " is badly formatted"};
-		throw std::exception(err.c_str());
+	stick.x_index = MappingIndex(x_name);
+	stick.y_index = MappingIndex(y_name);
+	if (stick.x_index == -1 || stick.y_index == -1) {
+		return false;
 	}
 
-	return line.substr(attribute_start + 1,
-			   attribute_end - attribute_start - 1);
+	sticks_.push_back(stick);
+	return true;
 }
 
 } // namespace slask_spy
@@ -1,122 +1,274 @@
 #include "viewer.h"
 
+#include <cmath>
 #include <cstdint>
+#include <iterator>
+#include <string>
 #include <string_view>
-#include <unordered_map>
 
 #include "logger.h"
+#include "skin_settings.h"
+#include "timing.h"
+#include "viewers/classic_viewer.h"
+#include "viewers/custom_viewer.h"
 #include "viewers/gamecube_viewer.h"
+#include "viewers/gba_viewer.h"
 #include "viewers/n64_viewer.h"
+#include "viewers/nes_viewer.h"
+#include "viewers/protocol_viewer.h"
+#include "viewers/snes_viewer.h"
 
 namespace slask_spy {
-Viewer *Viewer::CreateViewer(ViewerType type)
+namespace {
+struct ViewerEntry {
+	ViewerType type;
+	std::string_view name;
+	std::string_view display_name;
+	Viewer *(*create)();
+	int32_t (*mapping_index)(std::string_view name);
+};
+
+template<typename Protocol> constexpr ViewerEntry MakeEntry()
+{
+	return ViewerEntry{
+		Protocol::kType, Protocol::kName, Protocol::kDisplayName,
+		[]() -> Viewer * { return new ProtocolViewer<Protocol>(); },
+		[](std::string_view name) {
+			return ProtocolViewer<Protocol>::GetMappingIndex(name);
+		}};
+}
+
+// Every supported controller, adding a descriptor here is all it takes
+constexpr ViewerEntry kViewers[]{
+	MakeEntry<N64Protocol>(),     MakeEntry<GamecubeProtocol>(),
+	MakeEntry<NESProtocol>(),     MakeEntry<SNESProtocol>(),
+	MakeEntry<ClassicProtocol>(), MakeEntry<GBAProtocol>()};
+
+constexpr ViewerEntry const *FindEntry(ViewerType type)
+{
+	for (ViewerEntry const &entry : kViewers) {
+		if (entry.type == type) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+constexpr bool EntriesUnique()
 {
-	switch (type) {
-	case ViewerType::kN64:
-		return new N64Viewer();
-	case ViewerType::kGC:
-		return new GamecubeViewer();
-	case ViewerType::kNull:
-	default:
+	for (size_t i{0}; i < std::size(kViewers); ++i) {
+		for (size_t j{i + 1}; j < std::size(kViewers); ++j) {
+			if (kViewers[i].type == kViewers[j].type ||
+			    kViewers[i].name == kViewers[j].name) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+static_assert(EntriesUnique());
+} // namespace
+
+Viewer *Viewer::CreateViewer(ViewerType type, SkinSettings const *skin)
+{
+	if (type == ViewerType::kCustom) {
+		if (skin == nullptr || skin->GetProtocol() == nullptr) {
+			Logger::Error("viewer: Custom viewer without protocol");
+			return nullptr;
+		}
+		return new CustomViewer(*skin->GetProtocol());
+	}
+
+	ViewerEntry const *const entry{FindEntry(type)};
+	if (entry == nullptr) {
 		return nullptr;
 	}
+	return entry->create();
 }
 
 std::string Viewer::StringFromType(ViewerType type)
 {
-	switch (type) {
-	case ViewerType::kN64:
-		return "N64";
-	case ViewerType::kGC:
-		return "GameCube";
-	case ViewerType::kNull:
-	default:
+	if (type == ViewerType::kCustom) {
+		return "Custom";
+	}
+
+	ViewerEntry const *const entry{FindEntry(type)};
+	if (entry == nullptr) {
 		return "None";
 	}
+	return std::string{entry->display_name};
 }
 
 ViewerType Viewer::TypeFromString(std::string_view type_string)
 {
-	static const std::unordered_map<std::string_view, ViewerType> kTypeMap{
-		{"n64", ViewerType::kN64},
-		{"gamecube", ViewerType::kGC}};
+	if (type_string == "custom") {
+		return ViewerType::kCustom;
+	}
 
-	auto const it = kTypeMap.find(type_string);
-	if (it == kTypeMap.end()) {
-		return ViewerType::kNull;
+	for (ViewerEntry const &entry : kViewers) {
+		if (entry.name == type_string) {
+			return entry.type;
+		}
 	}
-	return it->second;
+	return ViewerType::kNull;
 }
 
 int32_t Viewer::GetMappingIndex(std::string_view name, ViewerType type)
 {
-	std::unordered_map<std::string_view, int32_t> const *mappings{nullptr};
-	switch (type) {
-	case slask_spy::ViewerType::kN64:
-		mappings = &N64Viewer::GetMapping();
-		break;
-	case slask_spy::ViewerType::kGC:
-		mappings = &GamecubeViewer::GetMapping();
-		break;
-	default:
-	case slask_spy::ViewerType::kNull:
+	ViewerEntry const *const entry{FindEntry(type)};
+	if (entry == nullptr) {
 		Logger::Error("viewer: Viewer type not found");
 		return -1;
 	}
 
-	auto const it1 = mappings->find(name);
-	if (it1 == mappings->end()) {
-		Logger::Error("viewer: Invalid name: %s", name.data());
-		return -1;
+	int32_t const index{entry->mapping_index(name)};
+	if (index == -1) {
+		Logger::Error("viewer: Invalid name: %.*s",
+			      static_cast<int>(name.size()), name.data());
 	}
-	return it1->second;
+	return index;
 }
 
-void Viewer::SetStickData(char *data, InputStick *stick)
+bool Viewer::PublishState(ControllerState &state, uint64_t arrival_ns)
 {
-	int8_t x{0};
-	int8_t y{0};
-	const int32_t x_index{stick->IndexX()};
-	const int32_t y_index{stick->IndexY()};
-	for (int32_t i{0}; i < 8; ++i) {
-		x |= data[x_index + i] ? (0x80 >> i) : 0;
-		y |= data[y_index + i] ? (0x80 >> i) : 0;
-	}
-	stick->Update(x, y);
+	state.arrival_ns = arrival_ns;
+	state.decoded_ns = MonotonicNanoseconds();
+	latency_.decode.Record(state.decoded_ns - arrival_ns);
+
+	// Axis bytes are derived from the same bits, the button mask alone
+	// tells what changed
+	uint64_t const changed{published_ ? state.buttons ^ last_state_.buttons
+					  : ~0ULL};
+	if (changed == 0) {
+		return false;
+	}
+
+	last_state_ = state;
+	published_ = true;
+	state_buffer_.WriteBuffer() = state;
+	state_buffer_.Publish();
+
+	for (auto const &callback : change_callbacks_) {
+		callback(changed, state);
+	}
+	return true;
 }
 
-void Viewer::SetIncommingData(char *data)
+bool Viewer::ApplyLatestState()
 {
-	for (auto it : assigned_buttons_) {
-		it->Update(data[it->Index()]);
+	if (!state_buffer_.Fetch()) {
+		return false;
+	}
+
+	// Diff against what was last applied rather than the previous frame,
+	// intermediate snapshots may have been skipped
+	ControllerState const &state{state_buffer_.ReadBuffer()};
+	latency_.render.Record(MonotonicNanoseconds() - state.arrival_ns);
+
+	uint64_t const changed{applied_ ? state.buttons ^ applied_buttons_
+					: ~0ULL};
+	applied_buttons_ = state.buttons;
+	applied_ = true;
+
+	if (scene_ == nullptr) {
+		return true;
 	}
+	SceneState &scene{*scene_};
 
-	for (auto it : assigned_sticks_) {
-		SetStickData(data, it);
+	// Branchless, rewriting every visibility bit is cheaper than testing
+	// which ones changed
+	for (size_t i{0}; i < button_elements_.size(); ++i) {
+		scene.SetVisible(button_elements_[i],
+				 state.Button(button_bits_[i]));
 	}
 
-	for (auto it : assigned_analogs_) {
-		uint8_t analog{0};
-		const int32_t index{it->Index()};
-		for (int32_t i{0}; i < 8; ++i) {
-			analog |= data[index + i] ? (0x80 >> i) : 0;
+	for (size_t i{0}; i < stick_elements_.size(); ++i) {
+		int32_t const index_x{stick_x_bits_[i]};
+		int32_t const index_y{stick_y_bits_[i]};
+		if ((((changed >> index_x) | (changed >> index_y)) & 0xFFU) ==
+		    0) {
+			continue;
 		}
-		it->Update(analog);
+		int8_t const x{static_cast<int8_t>(state.Axis(index_x) -
+						   kAxisCenter)};
+		int8_t const y{static_cast<int8_t>(state.Axis(index_y) -
+						   kAxisCenter)};
+		uint32_t const element{stick_elements_[i]};
+		scene.translation_x[element] =
+			scene.origin_x[element] + x * stick_ranges_x_[i];
+		scene.translation_y[element] =
+			scene.origin_y[element] - y * stick_ranges_y_[i];
 	}
+
+	for (size_t i{0}; i < analog_elements_.size(); ++i) {
+		int32_t const index{analog_bits_[i]};
+		if (((changed >> index) & 0xFFU) == 0) {
+			continue;
+		}
+		uint32_t const element{analog_elements_[i]};
+		DrawRegion const &full{scene.full_regions[element]};
+		DrawRegion &region{scene.regions[element]};
+		float const percentage{std::abs(
+			analog_reversed_[i] - state.Axis(index) / 255.f)};
+		uint32_t const width{
+			static_cast<uint32_t>(full.width * percentage)};
+		uint32_t const height{
+			static_cast<uint32_t>(full.height * percentage)};
+
+		switch (analog_directions_[i]) {
+		case AnalogDirection::kLeft:
+			region.x = full.width - width;
+			[[fallthrough]];
+		case AnalogDirection::kRight:
+			region.width = width;
+			break;
+		case AnalogDirection::kUp:
+			region.y = full.height - height;
+			[[fallthrough]];
+		case AnalogDirection::kDown:
+			region.height = height;
+			break;
+		}
+	}
+	return true;
+}
+
+void Viewer::SubscribeChanges(ChangeCallback const &callback)
+{
+	change_callbacks_.push_back(callback);
+}
+
+LatencyStats const &Viewer::GetLatencyStats() const
+{
+	return latency_;
+}
+
+void Viewer::BindScene(SceneState *scene)
+{
+	scene_ = scene;
 }
 
-void Viewer::AssignButton(InputButton *button_item)
+void Viewer::BindButton(ButtonSetting const &setting, uint32_t element)
 {
-	assigned_buttons_.push_back(button_item);
+	button_bits_.push_back(setting.index);
+	button_elements_.push_back(element);
 }
 
-void Viewer::AssignStick(InputStick *stick_item)
+void Viewer::BindStick(StickSetting const &setting, uint32_t element,
+		       float x_divisor, float y_divisor)
 {
-	assigned_sticks_.push_back(stick_item);
+	stick_x_bits_.push_back(setting.x_index);
+	stick_y_bits_.push_back(setting.y_index);
+	stick_ranges_x_.push_back(setting.x_range / x_divisor);
+	stick_ranges_y_.push_back(setting.y_range / y_divisor);
+	stick_elements_.push_back(element);
 }
 
-void Viewer::AssignAnalog(InputAnalog *analog)
+void Viewer::BindAnalog(AnalogSetting const &setting, uint32_t element)
 {
-	assigned_analogs_.push_back(analog);
+	analog_bits_.push_back(setting.index);
+	analog_directions_.push_back(setting.direction);
+	analog_reversed_.push_back(setting.reverse ? 1U : 0U);
+	analog_elements_.push_back(element);
 }
 } // namespace slask_spy
@@ -0,0 +1,89 @@
+#include "wake_handle.h"
+
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+#include "logger.h"
+
+namespace com_ports {
+#ifdef _WIN32
+WakeHandle::WakeHandle() : event_{CreateEventA(nullptr, TRUE, FALSE, nullptr)}
+{
+	if (event_ == nullptr) {
+		Logger::Error("wake_handle: Could not create event");
+	}
+}
+
+WakeHandle::~WakeHandle()
+{
+	if (event_ != nullptr) {
+		CloseHandle(event_);
+	}
+}
+
+void WakeHandle::Signal()
+{
+	SetEvent(event_);
+}
+
+void WakeHandle::Clear()
+{
+	ResetEvent(event_);
+}
+#else
+WakeHandle::WakeHandle() : read_fd_{-1}, write_fd_{-1}
+{
+#ifdef __linux__
+	read_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	write_fd_ = read_fd_;
+#else
+	int fds[2]{-1, -1};
+	if (pipe(fds) == 0) {
+		for (int const fd : fds) {
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+		}
+		read_fd_ = fds[0];
+		write_fd_ = fds[1];
+	}
+#endif
+	if (read_fd_ == -1) {
+		Logger::Error("wake_handle: Could not create wake descriptor");
+	}
+}
+
+WakeHandle::~WakeHandle()
+{
+	if (write_fd_ != -1 && write_fd_ != read_fd_) {
+		close(write_fd_);
+	}
+	if (read_fd_ != -1) {
+		close(read_fd_);
+	}
+}
+
+void WakeHandle::Signal()
+{
+	// A full pipe is already signaled, the result does not matter
+	uint64_t const value{1};
+	ssize_t const result{write(write_fd_, &value, sizeof(value))};
+	(void)result;
+}
+
+void WakeHandle::Clear()
+{
+	uint64_t value{0};
+	while (read(read_fd_, &value, sizeof(value)) > 0) {
+	}
+}
+#endif
+} // namespace com_ports
@@ -0,0 +1,236 @@
+#include "work_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "logger.h"
+
+namespace slask_spy {
+namespace {
+constexpr int32_t kHelpIntervalMilli{10};
+// Index of the queue owned by the current thread, only set on workers
+thread_local WorkPool const *current_pool{nullptr};
+thread_local size_t current_worker{0};
+} // namespace
+
+WorkPool &WorkPool::Instance()
+{
+	static WorkPool pool{};
+	return pool;
+}
+
+WorkPool::WorkPool()
+	: queues_{},
+	  threads_{},
+	  queued_{0},
+	  running_{false},
+	  mutex_{},
+	  wake_{}
+{
+	// Allocated once, tasks left behind by Stop stay reachable
+	for (size_t i{0}; i <= kMaxWorkers; ++i) {
+		queues_.push_back(new Queue{});
+	}
+}
+
+WorkPool::~WorkPool()
+{
+	Stop();
+	for (Queue *queue : queues_) {
+		delete queue;
+	}
+}
+
+void WorkPool::Start()
+{
+	if (!threads_.empty()) {
+		return;
+	}
+
+	size_t const cores{std::thread::hardware_concurrency()};
+	size_t const workers{
+		std::clamp<size_t>(cores > 1 ? cores - 1 : 1, 1, kMaxWorkers)};
+	running_ = true;
+	for (size_t i{0}; i < workers; ++i) {
+		threads_.push_back(new std::thread([this, i]() { Run(i); }));
+	}
+}
+
+void WorkPool::Stop()
+{
+	if (threads_.empty()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		running_ = false;
+	}
+	wake_.notify_all();
+	for (std::thread *thread : threads_) {
+		thread->join();
+		delete thread;
+	}
+	threads_.clear();
+}
+
+void WorkPool::Submit(std::function<void()> task)
+{
+	size_t const own{current_pool == this ? current_worker : kMaxWorkers};
+	{
+		std::lock_guard<std::mutex> lock{queues_[own]->mutex};
+		queues_[own]->tasks.push_back(std::move(task));
+	}
+	queued_.fetch_add(1);
+
+	// Taking the lock orders this with a worker about to sleep
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+	}
+	wake_.notify_one();
+}
+
+bool WorkPool::RunOne()
+{
+	size_t const own{current_pool == this ? current_worker : kMaxWorkers};
+	std::function<void()> task{};
+	if (!Take(own, &task)) {
+		return false;
+	}
+	task();
+	return true;
+}
+
+void WorkPool::Run(size_t worker)
+{
+	current_pool = this;
+	current_worker = worker;
+
+	std::function<void()> task{};
+	while (true) {
+		if (Take(worker, &task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		// Queued tasks are finished before a stopping worker exits
+		std::unique_lock<std::mutex> lock{mutex_};
+		if (!running_ && queued_ == 0) {
+			break;
+		}
+		wake_.wait(lock, [this]() { return queued_ > 0 || !running_; });
+	}
+
+	current_pool = nullptr;
+}
+
+bool WorkPool::Take(size_t own, std::function<void()> *task)
+{
+	if (queued_ == 0) {
+		return false;
+	}
+
+	{
+		Queue &queue{*queues_[own]};
+		std::lock_guard<std::mutex> lock{queue.mutex};
+		if (!queue.tasks.empty()) {
+			*task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			queued_.fetch_sub(1);
+			return true;
+		}
+	}
+
+	for (size_t i{1}; i < queues_.size(); ++i) {
+		Queue &queue{*queues_[(own + i) % queues_.size()]};
+		std::lock_guard<std::mutex> lock{queue.mutex};
+		if (!queue.tasks.empty()) {
+			*task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			queued_.fetch_sub(1);
+			return true;
+		}
+	}
+	return false;
+}
+
+WorkGroup::WorkGroup(WorkPool &pool)
+	: pool_{pool},
+	  mutex_{},
+	  done_{},
+	  pending_{0}
+{
+}
+
+WorkGroup::~WorkGroup()
+{
+	Wait();
+}
+
+void WorkGroup::Submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		++pending_;
+	}
+
+	pool_.Submit([this, task = std::move(task)]() {
+		// A task that throws still has to count as finished, Wait
+		// would never return otherwise
+		try {
+			task();
+		} catch (std::exception const &error) {
+			Logger::Error("work_pool: Task failed: %s",
+				      error.what());
+		} catch (...) {
+			Logger::Error("work_pool: Task failed");
+		}
+
+		// Notified under the lock, Wait cannot return and destroy the
+		// group before this is done with it
+		std::lock_guard<std::mutex> lock{mutex_};
+		if (--pending_ == 0) {
+			done_.notify_all();
+		}
+	});
+}
+
+bool WorkGroup::Done() const
+{
+	std::lock_guard<std::mutex> lock{mutex_};
+	return pending_ == 0;
+}
+
+void WorkGroup::Wait()
+{
+	while (true) {
+		{
+			std::lock_guard<std::mutex> lock{mutex_};
+			if (pending_ == 0) {
+				return;
+			}
+		}
+
+		if (pool_.RunOne()) {
+			continue;
+		}
+
+		// What is left is running elsewhere. The timeout picks up tasks
+		// it queues when no worker is there to take them.
+		std::unique_lock<std::mutex> lock{mutex_};
+		std::chrono::milliseconds const interval{kHelpIntervalMilli};
+		if (done_.wait_for(lock, interval,
+				   [this]() { return pending_ == 0; })) {
+			return;
+		}
+	}
+}
+} // namespace slask_spy
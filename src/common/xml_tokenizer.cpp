@@ -0,0 +1,142 @@
+#include "xml_tokenizer.h"
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace slask_spy {
+namespace {
+bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Characters that end a tag or attribute name
+bool IsNameEnd(char c)
+{
+	return IsSpace(c) || c == '=' || c == '/' || c == '>';
+}
+
+size_t SkipSpace(std::string_view text, size_t pos)
+{
+	while (pos < text.size() && IsSpace(text[pos])) {
+		++pos;
+	}
+	return pos;
+}
+} // namespace
+
+bool XmlTag::Attribute(std::string_view attribute,
+		       std::string_view *value) const
+{
+	size_t pos{0};
+	while (true) {
+		pos = SkipSpace(attributes, pos);
+		size_t const name_start{pos};
+		while (pos < attributes.size() && !IsNameEnd(attributes[pos])) {
+			++pos;
+		}
+		if (pos == name_start) {
+			return false;
+		}
+		std::string_view const attribute_name{
+			attributes.substr(name_start, pos - name_start)};
+
+		pos = SkipSpace(attributes, pos);
+		if (pos == attributes.size() || attributes[pos] != '=') {
+			return false;
+		}
+		pos = SkipSpace(attributes, pos + 1);
+		if (pos == attributes.size() ||
+		    (attributes[pos] != '"' && attributes[pos] != '\'')) {
+			return false;
+		}
+
+		size_t const close{attributes.find(attributes[pos], pos + 1)};
+		if (close == std::string_view::npos) {
+			return false;
+		}
+		if (attribute_name == attribute) {
+			*value = attributes.substr(pos + 1, close - pos - 1);
+			return true;
+		}
+		pos = close + 1;
+	}
+}
+
+bool XmlTag::IntAttribute(std::string_view attribute, int32_t *value) const
+{
+	std::string_view text{};
+	if (!Attribute(attribute, &text)) {
+		return false;
+	}
+	char const *const last{text.data() + text.size()};
+	auto const [end, error]{std::from_chars(text.data(), last, *value)};
+	return error == std::errc{} && end == last && !text.empty();
+}
+
+bool XmlTokenizer::Next(XmlTag *tag)
+{
+	while (pos_ < text_.size()) {
+		size_t const open{text_.find('<', pos_)};
+		if (open == std::string_view::npos) {
+			pos_ = text_.size();
+			return false;
+		}
+
+		// Comments may hold '>', skip them whole
+		if (text_.compare(open, 4, "<!--") == 0) {
+			size_t const end{text_.find("-->", open + 4)};
+			if (end == std::string_view::npos) {
+				pos_ = text_.size() + 1;
+				return false;
+			}
+			pos_ = end + 3;
+			continue;
+		}
+
+		// Quoted values may hold '>'
+		size_t close{open + 1};
+		while (close < text_.size() && text_[close] != '>') {
+			if (text_[close] == '"' || text_[close] == '\'') {
+				close = text_.find(text_[close], close + 1);
+				if (close == std::string_view::npos) {
+					break;
+				}
+			}
+			++close;
+		}
+		if (close >= text_.size()) {
+			pos_ = text_.size() + 1;
+			return false;
+		}
+		pos_ = close + 1;
+
+		// Declarations and processing instructions
+		char const kind{text_[open + 1]};
+		if (kind == '?' || kind == '!') {
+			continue;
+		}
+
+		size_t name_start{open + 1};
+		tag->closing = kind == '/';
+		if (tag->closing) {
+			++name_start;
+		}
+		size_t name_end{name_start};
+		while (name_end < close && !IsNameEnd(text_[name_end])) {
+			++name_end;
+		}
+		tag->self_closing = text_[close - 1] == '/' &&
+				    close - 1 >= name_end;
+		size_t const attributes_end{tag->self_closing ? close - 1
+							       : close};
+		tag->name = text_.substr(name_start, name_end - name_start);
+		tag->attributes = text_.substr(name_end,
+					       attributes_end - name_end);
+		return true;
+	}
+	return false;
+}
+} // namespace slask_spy